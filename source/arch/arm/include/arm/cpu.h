@@ -29,6 +29,7 @@
 #define ARM_SCTLR_Z		(1<<11)	/**< Branch prediction enable. */
 #define ARM_SCTLR_I		(1<<12)	/**< Instruction cache enable. */
 #define ARM_SCTLR_V		(1<<13)	/**< Hivecs enable. */
+#define ARM_SCTLR_XP		(1<<23)	/**< Extended page tables (ARMv6). */
 
 /** Definitions of mode bits in CPSR. */
 #define ARM_MODE_USR		0x10	/**< User. */
@@ -40,6 +41,8 @@
 
 #ifndef __ASM__
 
+#include <types.h>
+
 /** Execute a data memory barrier. */
 static inline void arm_dmb(void) {
 #if __ARM_ARCH >= 7
@@ -67,5 +70,23 @@ static inline void arm_isb(void) {
 #endif
 }
 
+/** Read the SCTLR register.
+ * @return		Value of SCTLR. */
+static inline uint32_t arm_read_sctlr(void) {
+	uint32_t value;
+
+	__asm__ volatile("mrc p15, 0, %0, c1, c0, 0" : "=r"(value));
+	return value;
+}
+
+/** Read the ID_MMFR3 register.
+ * @return		Value of ID_MMFR3. */
+static inline uint32_t arm_read_id_mmfr3(void) {
+	uint32_t value;
+
+	__asm__ volatile("mrc p15, 0, %0, c0, c1, 7" : "=r"(value));
+	return value;
+}
+
 #endif /* __ASM__ */
 #endif /* __ARM_CPU_H */
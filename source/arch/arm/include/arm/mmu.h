@@ -24,10 +24,17 @@
 
 #include <mmu.h>
 
+/** Size of a second level table. */
+#define ARM_L2_TABLE_SIZE	0x400
+
+/** Size of a supersection (16 first level entries). */
+#define ARM_SUPERSECTION_SIZE	0x1000000
+
 /** ARM MMU context structure. */
 struct mmu_context {
 	phys_ptr_t l1;			/**< Physical address of first level table. */
 	unsigned phys_type;		/**< Physical memory type for page tables. */
+	phys_ptr_t l2_next;		/**< Next free second level table in current page. */
 };
 
 #endif /* __ARM_MMU_H */
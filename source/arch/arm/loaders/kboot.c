@@ -19,6 +19,8 @@
  * @brief		ARM KBoot kernel loader.
  */
 
+#include <arch/page.h>
+
 #include <arm/mmu.h>
 
 #include <loaders/kboot.h>
@@ -50,10 +52,11 @@ extern size_t kboot_trampoline32_size;
 /** Check a kernel image and determine the target type.
  * @param loader	KBoot loader data structure. */
 void kboot_arch_check(kboot_loader_t *loader) {
-	if(!elf_check(loader->kernel, ELFCLASS32, ELFDATA2LSB, ELF_EM_ARM))
+	if(!elf_header_check(loader->ehdr, ELFCLASS32, ELFDATA2LSB, ELF_EM_ARM))
 		boot_error("Kernel image is not for this architecture");
 
 	loader->target = TARGET_TYPE_32BIT;
+	loader->large_page_size = LARGE_PAGE_SIZE;
 }
 
 /** Validate kernel load parameters.
@@ -19,6 +19,7 @@
  * @brief		ARM MMU functions.
  */
 
+#include <arm/cpu.h>
 #include <arm/mmu.h>
 
 #include <lib/string.h>
@@ -36,6 +37,90 @@ static phys_ptr_t allocate_structure(mmu_context_t *ctx, size_t size) {
 	return addr;
 }
 
+/** Allocate a second level table.
+ * @param ctx		Context to allocate for.
+ * @return		Physical address of table. */
+static phys_ptr_t allocate_l2(mmu_context_t *ctx) {
+	phys_ptr_t addr;
+
+	/* Second level tables are only 1KB, so pack 4 of them into each page
+	 * that we allocate. */
+	if(!(ctx->l2_next % PAGE_SIZE))
+		ctx->l2_next = allocate_structure(ctx, PAGE_SIZE);
+
+	addr = ctx->l2_next;
+	ctx->l2_next += ARM_L2_TABLE_SIZE;
+	return addr;
+}
+
+/** Whether supersections are supported (-1 if not yet checked). */
+static int supersections_supported = -1;
+
+/** Check whether the CPU supports supersections.
+ * @return		Whether supersections are supported. */
+static bool have_supersections(void) {
+	/* ID_MMFR3[31:28] is 0xF if supersections are not supported. On
+	 * ARMv6 it reads as 0, and all ARMv6 cores we run on support them,
+	 * but only in the extended page table format selected by SCTLR.XP.
+	 * The loader does not change XP, as the kernel may depend on the
+	 * format that the firmware left enabled. XP always reads as 1 on
+	 * ARMv7. */
+	if(supersections_supported < 0) {
+		supersections_supported = (arm_read_sctlr() & ARM_SCTLR_XP)
+			&& (arm_read_id_mmfr3() >> 28) != 0xF;
+	}
+
+	return supersections_supported;
+}
+
+/** Split a section or supersection so that part of it can be remapped.
+ * @param ctx		Context to split in.
+ * @param l1e		First level entry to split. */
+static void split_section(mmu_context_t *ctx, int l1e) {
+	uint32_t *l1, *l2;
+	phys_ptr_t addr;
+	uint32_t base;
+	int i;
+
+	l1 = (uint32_t *)P2V(ctx->l1);
+
+	/* A supersection is repeated across 16 entries, turn them all into
+	 * ordinary sections first. */
+	if(l1[l1e] & (1<<18)) {
+		base = l1[l1e] & 0xFF000000;
+		for(i = 0; i < 16; i++)
+			l1[(l1e & ~15) + i] = (base + (i * LARGE_PAGE_SIZE)) | (1<<1) | (1<<10);
+	}
+
+	/* Replace the section with a second level table. */
+	base = l1[l1e] & 0xFFF00000;
+	addr = allocate_l2(ctx);
+	l2 = (uint32_t *)P2V(addr);
+	for(i = 0; i < (LARGE_PAGE_SIZE / PAGE_SIZE); i++)
+		l2[i] = (base + (i * PAGE_SIZE)) | (1<<1) | (1<<4);
+
+	l1[l1e] = addr | (1<<0);
+}
+
+/** Map a supersection in a context.
+ * @param ctx		Context to map in.
+ * @param virt		Virtual address to map.
+ * @param phys		Physical address to map to. */
+static void map_supersection(mmu_context_t *ctx, ptr_t virt, phys_ptr_t phys) {
+	uint32_t *l1;
+	int l1e, i;
+
+	assert(!(virt % ARM_SUPERSECTION_SIZE));
+	assert(!(phys % ARM_SUPERSECTION_SIZE));
+
+	/* Supersection descriptors must be repeated in 16 consecutive
+	 * entries. */
+	l1 = (uint32_t *)P2V(ctx->l1);
+	l1e = virt / LARGE_PAGE_SIZE;
+	for(i = 0; i < 16; i++)
+		l1[l1e + i] = phys | (1<<18) | (1<<1) | (1<<10);
+}
+
 /** Map a section in a context.
  * @param ctx		Context to map in.
  * @param virt		Virtual address to map.
@@ -49,6 +134,11 @@ static void map_section(mmu_context_t *ctx, ptr_t virt, phys_ptr_t phys) {
 
 	l1 = (uint32_t *)P2V(ctx->l1);
 	l1e = virt / LARGE_PAGE_SIZE;
+
+	/* If the section is currently part of a supersection, split it. */
+	if((l1[l1e] & 0x3) == 0x2 && l1[l1e] & (1<<18))
+		split_section(ctx, l1e);
+
 	l1[l1e] = phys | (1<<1) | (1<<10);
 }
 
@@ -58,16 +148,14 @@ static void map_section(mmu_context_t *ctx, ptr_t virt, phys_ptr_t phys) {
  * @param phys		Physical address to map to. */
 static void map_small(mmu_context_t *ctx, ptr_t virt, phys_ptr_t phys) {
 	uint32_t *l1, *l2;
-	phys_ptr_t addr;
 	int l1e, l2e;
 
 	l1 = (uint32_t *)P2V(ctx->l1);
 	l1e = virt / LARGE_PAGE_SIZE;
-	if(!(l1[l1e] & (1<<0))) {
-		/* FIXME: Second level tables are actually 1KB. Should probably
-		 * split up these pages and use them fully. */
-		addr = allocate_structure(ctx, PAGE_SIZE);
-		l1[l1e] = addr | (1<<0);
+	if(!(l1[l1e] & 0x3)) {
+		l1[l1e] = allocate_l2(ctx) | (1<<0);
+	} else if((l1[l1e] & 0x3) == 0x2) {
+		split_section(ctx, l1e);
 	}
 
 	l2 = (uint32_t *)P2V(l1[l1e] & 0xFFFFFC00);
@@ -99,6 +187,25 @@ bool mmu_map(mmu_context_t *ctx, target_ptr_t virt, phys_ptr_t phys, target_size
 			phys += PAGE_SIZE;
 			size -= PAGE_SIZE;
 		}
+
+		/* Do the same again with 16MB supersections if possible. */
+		if((virt % ARM_SUPERSECTION_SIZE) == (phys % ARM_SUPERSECTION_SIZE)
+			&& size >= ARM_SUPERSECTION_SIZE && have_supersections())
+		{
+			while(virt % ARM_SUPERSECTION_SIZE && size >= LARGE_PAGE_SIZE) {
+				map_section(ctx, virt, phys);
+				virt += LARGE_PAGE_SIZE;
+				phys += LARGE_PAGE_SIZE;
+				size -= LARGE_PAGE_SIZE;
+			}
+			while(size / ARM_SUPERSECTION_SIZE) {
+				map_supersection(ctx, virt, phys);
+				virt += ARM_SUPERSECTION_SIZE;
+				phys += ARM_SUPERSECTION_SIZE;
+				size -= ARM_SUPERSECTION_SIZE;
+			}
+		}
+
 		while(size / LARGE_PAGE_SIZE) {
 			map_section(ctx, virt, phys);
 			virt += LARGE_PAGE_SIZE;
@@ -126,5 +233,6 @@ mmu_context_t *mmu_context_create(target_type_t target, unsigned phys_type) {
 	ctx = kmalloc(sizeof(*ctx));
 	ctx->phys_type = phys_type;
 	ctx->l1 = allocate_structure(ctx, 0x4000);
+	ctx->l2_next = 0;
 	return ctx;
 }
@@ -137,6 +137,18 @@ void spin(timeout_t us) {
 		__asm__ volatile("pause");
 }
 
+/** Get the current value of the timestamp counter.
+ * @return		Current TSC value. */
+uint64_t arch_timestamp(void) {
+	return rdtsc();
+}
+
+/** Get the frequency of the timestamp counter.
+ * @return		TSC frequency in Hz (0 if not yet calculated). */
+uint64_t arch_timestamp_frequency(void) {
+	return cpu_frequency;
+}
+
 /** Handle an exception.
  * @param frame		Interrupt frame. */
 void interrupt_handler(interrupt_frame_t *frame) {
@@ -84,6 +84,7 @@
 #define X86_CPUID_CACHE_PARMS	0x00000004	/**< Deterministic Cache Parameters. */
 #define X86_CPUID_MONITOR_MWAIT	0x00000005	/**< MONITOR/MWAIT Parameters. */
 #define X86_CPUID_DTS_POWER	0x00000006	/**< Digital Thermal Sensor and Power Management Parameters. */
+#define X86_CPUID_STRUCT_EXT	0x00000007	/**< Structured Extended Feature Flags. */
 #define X86_CPUID_DCA		0x00000009	/**< Direct Cache Access (DCA) Parameters. */
 #define X86_CPUID_PERFMON	0x0000000A	/**< Architectural Performance Monitor Features. */
 #define X86_CPUID_X2APIC	0x0000000B	/**< x2APIC Features/Processor Topology. */
@@ -99,6 +100,16 @@
 #define X86_CPUID_ADVANCED_PM	0x80000007	/**< Advanced Power Management. */
 #define X86_CPUID_ADDRESS_SIZE	0x80000008	/**< Virtual/Physical Address Sizes. */
 
+/** Standard feature bits (ECX of X86_CPUID_FEATURE_INFO). */
+#define X86_FEATURE_SSSE3	(1<<9)		/**< Supplemental SSE3 Extensions. */
+
+/** Structured extended feature bits (EBX of X86_CPUID_STRUCT_EXT). */
+#define X86_STRUCT_FEATURE_SHA	(1<<29)		/**< SHA Extensions. */
+
+/** Extended feature bits (EDX of X86_CPUID_EXT_FEATURE). */
+#define X86_EXT_FEATURE_PDPE1GB	(1<<26)		/**< 1GB pages. */
+#define X86_EXT_FEATURE_LM	(1<<29)		/**< Long Mode. */
+
 #ifndef __ASM__
 
 #include <types.h>
@@ -167,5 +178,18 @@ static inline void x86_cpuid(uint32_t level, uint32_t *a, uint32_t *b, uint32_t
 	__asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "0"(level));
 }
 
+/** Execute the CPUID instruction for a level with subleaves.
+ * @param level		CPUID level.
+ * @param subleaf	Subleaf to query (passed in ECX).
+ * @param a		Where to store EAX value.
+ * @param b		Where to store EBX value.
+ * @param c		Where to store ECX value.
+ * @param d		Where to store EDX value. */
+static inline void x86_cpuid_count(uint32_t level, uint32_t subleaf, uint32_t *a, uint32_t *b,
+	uint32_t *c, uint32_t *d)
+{
+	__asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "0"(level), "2"(subleaf));
+}
+
 #endif /* __ASM__ */
 #endif /* __ARCH_X86_CPU_H */
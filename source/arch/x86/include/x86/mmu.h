@@ -35,11 +35,23 @@
 #define X86_PTE_LARGE		(1<<7)	/**< Page is a large page. */
 #define X86_PTE_GLOBAL		(1<<8)	/**< Page won't be cleared in TLB. */
 
+/** Number of entries in the software translation cache. */
+#define X86_MMU_TLB_SIZE	64
+
+/** Software translation cache entry. */
+typedef struct x86_tlb_entry {
+	uint64_t virt;			/**< Virtual address of the page (bit 0 set if valid). */
+	ptr_t page;			/**< Loader address of the page. */
+} x86_tlb_entry_t;
+
 /** x86 MMU context structure. */
 struct mmu_context {
 	uint32_t cr3;			/**< Value loaded into CR3. */
 	bool is64;			/**< Whether this is a 64-bit context. */
 	unsigned phys_type;		/**< Physical memory type for page tables. */
+
+	/** Cache of translations used by mmu_memset()/mmu_memcpy_*(). */
+	x86_tlb_entry_t tlb[X86_MMU_TLB_SIZE];
 };
 
 #endif /* __X86_MMU_H */
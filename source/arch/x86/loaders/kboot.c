@@ -57,7 +57,7 @@ static inline bool have_long_mode(void) {
 	x86_cpuid(X86_CPUID_EXT_MAX, &eax, &ebx, &ecx, &edx);
 	if(eax & (1<<31)) {
 		x86_cpuid(X86_CPUID_EXT_FEATURE, &eax, &ebx, &ecx, &edx);
-		if(edx & (1<<29))
+		if(edx & X86_EXT_FEATURE_LM)
 			return true;
 	}
 
@@ -75,14 +75,16 @@ void kboot_arch_check(kboot_loader_t *loader) {
 	if((x86_read_flags() & X86_FLAGS_ID) == (flags & X86_FLAGS_ID))
 		boot_error("CPU does not support CPUID");
 
-	if(elf_check(loader->kernel, ELFCLASS64, ELFDATA2LSB, ELF_EM_X86_64)) {
+	if(elf_header_check(loader->ehdr, ELFCLASS64, ELFDATA2LSB, ELF_EM_X86_64)) {
 		loader->target = TARGET_TYPE_64BIT;
+		loader->large_page_size = 0x200000;
 
 		/* Check for 64-bit support. */
 		if(!have_long_mode())
 			boot_error("64-bit kernel requires 64-bit CPU");
-	} else if(elf_check(loader->kernel, ELFCLASS32, ELFDATA2LSB, ELF_EM_386)) {
+	} else if(elf_header_check(loader->ehdr, ELFCLASS32, ELFDATA2LSB, ELF_EM_386)) {
 		loader->target = TARGET_TYPE_32BIT;
+		loader->large_page_size = 0x400000;
 	} else {
 		boot_error("Kernel image is not for this architecture");
 	}
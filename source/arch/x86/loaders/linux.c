@@ -39,6 +39,8 @@
 #include <fs.h>
 #include <loader.h>
 #include <memory.h>
+#include <trace.h>
+#include <verify.h>
 
 extern __noreturn void linux_arch_enter(ptr_t entry, ptr_t params, ptr_t sp);
 
@@ -191,7 +193,10 @@ void linux_arch_load(file_handle_t *kernel, file_handle_t *initrd, const char *c
 	if(!file_read(kernel, (void *)P2V(load_addr), prot_size, prot_offset))
 		boot_error("Failed to read kernel image");
 
+	verify_end(kernel, "kernel");
+
 	/* Load in the initrd. */
+	trace_phase(TRACE_PHASE_MODULES);
 	if(initrd) {
 		initrd_size = file_size(initrd);
 		initrd_max = (params->hdr.version >= 0x0203)
@@ -213,6 +218,8 @@ void linux_arch_load(file_handle_t *kernel, file_handle_t *initrd, const char *c
 		if(!file_read(initrd, (void *)P2V(load_addr), initrd_size, 0))
 			boot_error("Failed to read initrd");
 
+		verify_end(initrd, "initrd");
+
 		params->hdr.ramdisk_image = load_addr;
 		params->hdr.ramdisk_size = initrd_size;
 	} else {
@@ -233,6 +240,7 @@ void linux_arch_load(file_handle_t *kernel, file_handle_t *initrd, const char *c
 
 	/* Start the kernel. Stack is positioned points below the parameters. */
 	dprintf("linux: kernel entry point at 0x%x, params at %p\n", params->hdr.code32_start, params);
+	trace_phase(TRACE_PHASE_HANDOFF);
 	linux_arch_enter(params->hdr.code32_start, (ptr_t)params, (ptr_t)params);
 }
 
@@ -25,6 +25,7 @@
 #include <x86/mmu.h>
 
 #include <lib/string.h>
+#include <lib/utility.h>
 
 #include <assert.h>
 #include <loader.h>
@@ -41,14 +42,85 @@ static phys_ptr_t allocate_structure(mmu_context_t *ctx) {
 	return addr;
 }
 
-/** Get a page directory from a 64-bit context.
+/** Invalidate cached translations for a range.
+ * @param ctx		Context to invalidate in.
+ * @param virt		Start of the range.
+ * @param size		Size of the range (0 to invalidate everything). */
+static void invalidate_tlb(mmu_context_t *ctx, target_ptr_t virt, target_size_t size) {
+	target_ptr_t page;
+	target_size_t i;
+
+	if(!size || size / PAGE_SIZE >= X86_MMU_TLB_SIZE) {
+		memset(ctx->tlb, 0, sizeof(ctx->tlb));
+		return;
+	}
+
+	/* Loop over a page count, as the range may end at the top of the
+	 * address space, where virt + size wraps to 0. */
+	for(i = 0; i < size / PAGE_SIZE; i++) {
+		page = virt + (i * PAGE_SIZE);
+		if(ctx->tlb[(page / PAGE_SIZE) % X86_MMU_TLB_SIZE].virt == (page | 1))
+			ctx->tlb[(page / PAGE_SIZE) % X86_MMU_TLB_SIZE].virt = 0;
+	}
+}
+
+/** Whether 1GB pages are supported (-1 if not yet checked). */
+static int huge_pages_supported = -1;
+
+/** Check whether the CPU supports 1GB pages.
+ * @return		Whether 1GB pages are supported. */
+static bool have_huge_pages(void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	if(huge_pages_supported < 0) {
+		huge_pages_supported = 0;
+
+		x86_cpuid(X86_CPUID_EXT_MAX, &eax, &ebx, &ecx, &edx);
+		if(eax >= X86_CPUID_EXT_FEATURE) {
+			x86_cpuid(X86_CPUID_EXT_FEATURE, &eax, &ebx, &ecx, &edx);
+			if(edx & X86_EXT_FEATURE_PDPE1GB)
+				huge_pages_supported = 1;
+		}
+
+		dprintf("mmu: 1GB pages are %ssupported\n", (huge_pages_supported) ? "" : "not ");
+	}
+
+	return huge_pages_supported;
+}
+
+/** Split a large page into a table of smaller pages.
+ * @param ctx		Context the entry belongs to.
+ * @param entry		Entry mapping the large page. It will be replaced with
+ *			a table mapping the same range.
+ * @param size		Size of the large page. */
+static void split_large64(mmu_context_t *ctx, uint64_t *entry, uint64_t size) {
+	uint64_t *table, base, flags;
+	phys_ptr_t addr;
+	int i;
+
+	base = *entry & 0x000000FFFFFFF000LL & ~(size - 1);
+	flags = *entry & 0xFFF;
+
+	/* If the new pages are 4KB, they are not large pages. */
+	if(size / 512 == PAGE_SIZE)
+		flags &= ~X86_PTE_LARGE;
+
+	addr = allocate_structure(ctx);
+	table = (uint64_t *)P2V(addr);
+	for(i = 0; i < 512; i++)
+		table[i] = (base + (i * (size / 512))) | flags;
+
+	*entry = addr | X86_PTE_PRESENT | X86_PTE_WRITE;
+}
+
+/** Get a page directory pointer table from a 64-bit context.
  * @param ctx		Context to get from.
  * @param virt		Virtual address to get for.
- * @return		Address of page directory. */
-static uint64_t *get_pdir64(mmu_context_t *ctx, uint64_t virt) {
-	uint64_t *pml4, *pdp;
+ * @return		Address of page directory pointer table. */
+static uint64_t *get_pdp64(mmu_context_t *ctx, uint64_t virt) {
+	uint64_t *pml4;
 	phys_ptr_t addr;
-	int pml4e, pdpe;
+	int pml4e;
 
 	pml4 = (uint64_t *)P2V(ctx->cr3);
 
@@ -60,19 +132,51 @@ static uint64_t *get_pdir64(mmu_context_t *ctx, uint64_t virt) {
 	}
 
 	/* Get the PDP from the PML4. */
-	pdp = (uint64_t *)P2V((ptr_t)(pml4[pml4e] & 0x000000FFFFFFF000LL));
+	return (uint64_t *)P2V((ptr_t)(pml4[pml4e] & 0x000000FFFFFFF000LL));
+}
 
-	/* Get the page directory number. A page directory covers 1GB. */
+/** Get a page directory from a 64-bit context.
+ * @param ctx		Context to get from.
+ * @param virt		Virtual address to get for.
+ * @return		Address of page directory. */
+static uint64_t *get_pdir64(mmu_context_t *ctx, uint64_t virt) {
+	uint64_t *pdp;
+	phys_ptr_t addr;
+	int pdpe;
+
+	pdp = get_pdp64(ctx, virt);
+
+	/* Get the page directory number. A page directory covers 1GB. If the
+	 * range is currently mapped with a 1GB page, split it up so that part
+	 * of it can be remapped. */
 	pdpe = (virt % 0x8000000000) / 0x40000000;
 	if(!(pdp[pdpe] & X86_PTE_PRESENT)) {
 		addr = allocate_structure(ctx);
 		pdp[pdpe] = addr | X86_PTE_PRESENT | X86_PTE_WRITE;
+	} else if(pdp[pdpe] & X86_PTE_LARGE) {
+		split_large64(ctx, &pdp[pdpe], 0x40000000);
 	}
 
 	/* Return the page directory address. */
 	return (uint64_t *)P2V((ptr_t)(pdp[pdpe] & 0x000000FFFFFFF000LL));
 }
 
+/** Map a 1GB page in a 64-bit context.
+ * @param ctx		Context to map in.
+ * @param virt		Virtual address to map.
+ * @param phys		Physical address to map to. */
+static void map_huge64(mmu_context_t *ctx, uint64_t virt, uint64_t phys) {
+	uint64_t *pdp;
+	int pdpe;
+
+	assert(!(virt % 0x40000000));
+	assert(!(phys % 0x40000000));
+
+	pdp = get_pdp64(ctx, virt);
+	pdpe = (virt % 0x8000000000) / 0x40000000;
+	pdp[pdpe] = phys | X86_PTE_PRESENT | X86_PTE_WRITE | X86_PTE_LARGE;
+}
+
 /** Map a large page in a 64-bit context.
  * @param ctx		Context to map in.
  * @param virt		Virtual address to map.
@@ -108,6 +212,8 @@ static void map_small64(mmu_context_t *ctx, uint64_t virt, uint64_t phys) {
 	if(!(pdir[pde] & X86_PTE_PRESENT)) {
 		addr = allocate_structure(ctx);
 		pdir[pde] = addr | X86_PTE_PRESENT | X86_PTE_WRITE;
+	} else if(pdir[pde] & X86_PTE_LARGE) {
+		split_large64(ctx, &pdir[pde], 0x200000);
 	}
 
 	/* Get the page table from the page directory. */
@@ -139,6 +245,25 @@ static bool mmu_map64(mmu_context_t *ctx, uint64_t virt, uint64_t phys, uint64_t
 			phys += PAGE_SIZE;
 			size -= PAGE_SIZE;
 		}
+
+		/* Do the same again with 1GB pages if the CPU supports them. */
+		if((virt % 0x40000000) == (phys % 0x40000000) && size >= 0x40000000
+			&& have_huge_pages())
+		{
+			while(virt % 0x40000000 && size >= 0x200000) {
+				map_large64(ctx, virt, phys);
+				virt += 0x200000;
+				phys += 0x200000;
+				size -= 0x200000;
+			}
+			while(size / 0x40000000) {
+				map_huge64(ctx, virt, phys);
+				virt += 0x40000000;
+				phys += 0x40000000;
+				size -= 0x40000000;
+			}
+		}
+
 		while(size / 0x200000) {
 			map_large64(ctx, virt, phys);
 			virt += 0x200000;
@@ -243,6 +368,7 @@ bool mmu_map(mmu_context_t *ctx, target_ptr_t virt, phys_ptr_t phys, target_size
 		return false;
 
 	if(ctx->is64) {
+		invalidate_tlb(ctx, virt, size);
 		return mmu_map64(ctx, virt, phys, size);
 	} else {
 		if(phys >= 0x100000000LL || (phys + size) > 0x100000000LL) {
@@ -271,6 +397,8 @@ bool mmu_alias(mmu_context_t *ctx, target_ptr_t target, target_ptr_t source, tar
 	assert((source % (512LL * 1024 * 1024 * 1024)) == 0);
 	assert((size % (512LL * 1024 * 1024 * 1024)) == 0);
 
+	invalidate_tlb(ctx, 0, 0);
+
 	uint64_t *pml4 = (uint64_t *)P2V(ctx->cr3);
 	while(size) {
 		/* Get the page directory pointer number. A PDP covers 512GB. */
@@ -296,105 +424,114 @@ mmu_context_t *mmu_context_create(target_type_t target, unsigned phys_type) {
 	ctx->is64 = target == TARGET_TYPE_64BIT;
 	ctx->phys_type = phys_type;
 	ctx->cr3 = allocate_structure(ctx);
+	invalidate_tlb(ctx, 0, 0);
 	return ctx;
 }
 
-static bool does_not_cross_page_boundary(uint64_t addr, uint64_t size) {
-	return size == 0 || addr / PAGE_SIZE == (addr + size - 1) / PAGE_SIZE;
-}
-
-/** Set bytes in an area of memory. The area must not cross a page boundary.
+/** Get a pointer to the memory mapped at an address in a 64-bit context.
  * @param ctx		Context to use.
- * @param addr		Virtual address to write to, must be mapped.
- * @param value		Value to write.
- * @param size		Number of bytes to write. */
-void mmu_memset(mmu_context_t *ctx, target_ptr_t addr, uint8_t value, target_size_t size) {
-	uint64_t *pdir, *ptbl;
-	ptr_t page;
-	int pde, pte;
+ * @param addr		Virtual address to translate, must be mapped.
+ * @return		Pointer to the memory (valid to the end of the page). */
+static void *walk64(mmu_context_t *ctx, uint64_t addr) {
+	uint64_t *pml4, *pdp, *pdir, *ptbl;
+	int pml4e, pdpe, pde, pte;
 
-	assert(ctx->is64);
-	assert(does_not_cross_page_boundary(addr, size));
-
-	pdir = get_pdir64(ctx, addr);
+	pml4 = (uint64_t *)P2V(ctx->cr3);
+	pml4e = (addr & 0x0000FFFFFFFFF000) / 0x8000000000;
+	assert(pml4[pml4e] & X86_PTE_PRESENT);
 
-	/* Get the page directory entry number. */
+	/* Get the page directory from the PDP, or the page if it is mapped
+	 * with a 1GB page. */
+	pdp = (uint64_t *)P2V((ptr_t)(pml4[pml4e] & 0x000000FFFFFFF000LL));
+	pdpe = (addr % 0x8000000000) / 0x40000000;
+	assert(pdp[pdpe] & X86_PTE_PRESENT);
+	if(pdp[pdpe] & X86_PTE_LARGE)
+		return (void *)P2V((ptr_t)((pdp[pdpe] & 0x000000FFC0000000LL) + (addr % 0x40000000)));
+
+	/* Get the page table from the page directory, or the page if it is
+	 * mapped with a large page. */
+	pdir = (uint64_t *)P2V((ptr_t)(pdp[pdpe] & 0x000000FFFFFFF000LL));
 	pde = (addr % 0x40000000) / 0x200000;
-
-	/* Get the page table from the page directory. */
 	assert(pdir[pde] & X86_PTE_PRESENT);
-	ptbl = (uint64_t *)P2V((ptr_t)(pdir[pde] & 0x000000FFFFFFF000LL));
-
-	/* Get the page table entry number. */
-	pte = (addr % 0x200000) / PAGE_SIZE;
+	if(pdir[pde] & X86_PTE_LARGE)
+		return (void *)P2V((ptr_t)((pdir[pde] & 0x000000FFFFE00000LL) + (addr % 0x200000)));
 
 	/* Get the page from the page table. */
+	ptbl = (uint64_t *)P2V((ptr_t)(pdir[pde] & 0x000000FFFFFFF000LL));
+	pte = (addr % 0x200000) / PAGE_SIZE;
 	assert(ptbl[pte] & X86_PTE_PRESENT);
-	page = P2V((ptr_t)(ptbl[pte] & 0x000000FFFFFFF000LL));
+	return (void *)P2V((ptr_t)((ptbl[pte] & 0x000000FFFFFFF000LL) + (addr % PAGE_SIZE)));
+}
 
-	memset((void *)(ptr_t)(page + addr % PAGE_SIZE), value, size);
+/** Translate an address in a 64-bit context, using the translation cache.
+ * @param ctx		Context to use.
+ * @param addr		Virtual address to translate, must be mapped.
+ * @return		Pointer to the memory (valid to the end of the page). */
+static void *translate64(mmu_context_t *ctx, uint64_t addr) {
+	uint64_t page = addr & ~((uint64_t)PAGE_SIZE - 1);
+	x86_tlb_entry_t *entry;
+
+	entry = &ctx->tlb[(page / PAGE_SIZE) % X86_MMU_TLB_SIZE];
+	if(entry->virt != (page | 1)) {
+		entry->virt = page | 1;
+		entry->page = (ptr_t)walk64(ctx, page);
+	}
+
+	return (void *)(entry->page + (ptr_t)(addr % PAGE_SIZE));
 }
 
-/** Set bytes in an area of memory. The area must not cross a page boundary.
+/** Set bytes in an area of memory.
  * @param ctx		Context to use.
  * @param addr		Virtual address to write to, must be mapped.
- * @param source	Memory to read from.
+ * @param value		Value to write.
  * @param size		Number of bytes to write. */
-void mmu_memcpy_to(mmu_context_t *ctx, target_ptr_t addr, const void *source, target_size_t size) {
-	uint64_t *pdir, *ptbl;
-	ptr_t page;
-	int pde, pte;
+void mmu_memset(mmu_context_t *ctx, target_ptr_t addr, uint8_t value, target_size_t size) {
+	target_size_t count;
 
 	assert(ctx->is64);
-	assert(does_not_cross_page_boundary(addr, size));
-
-	pdir = get_pdir64(ctx, addr);
-
-	/* Get the page directory entry number. */
-	pde = (addr % 0x40000000) / 0x200000;
 
-	/* Get the page table from the page directory. */
-	assert(pdir[pde] & X86_PTE_PRESENT);
-	ptbl = (uint64_t *)P2V((ptr_t)(pdir[pde] & 0x000000FFFFFFF000LL));
+	while(size) {
+		count = MIN(size, PAGE_SIZE - (addr % PAGE_SIZE));
+		memset(translate64(ctx, addr), value, count);
+		addr += count;
+		size -= count;
+	}
+}
 
-	/* Get the page table entry number. */
-	pte = (addr % 0x200000) / PAGE_SIZE;
+/** Copy data to an area of memory.
+ * @param ctx		Context to use.
+ * @param addr		Virtual address to write to, must be mapped.
+ * @param source	Memory to read from.
+ * @param size		Number of bytes to write. */
+void mmu_memcpy_to(mmu_context_t *ctx, target_ptr_t addr, const void *source, target_size_t size) {
+	target_size_t count;
 
-	/* Get the page from the page table. */
-	assert(ptbl[pte] & X86_PTE_PRESENT);
-	page = P2V((ptr_t)(ptbl[pte] & 0x000000FFFFFFF000LL));
+	assert(ctx->is64);
 
-	memcpy((void *)(ptr_t)(page + addr % PAGE_SIZE), source, size);
+	while(size) {
+		count = MIN(size, PAGE_SIZE - (addr % PAGE_SIZE));
+		memcpy(translate64(ctx, addr), source, count);
+		source += count;
+		addr += count;
+		size -= count;
+	}
 }
 
-/** Read bytes from an area of memory. The area must not cross a page boundary.
+/** Read bytes from an area of memory.
  * @param ctx		Context to use.
  * @param dest		Memory to write to.
  * @param addr		Virtual address to read from, must be mapped.
  * @param size		Number of bytes to read. */
 void mmu_memcpy_from(mmu_context_t *ctx, void *dest, target_ptr_t addr, target_size_t size) {
-	uint64_t *pdir, *ptbl;
-	ptr_t page;
-	int pde, pte;
+	target_size_t count;
 
 	assert(ctx->is64);
-	assert(does_not_cross_page_boundary(addr, size));
-
-	pdir = get_pdir64(ctx, addr);
 
-	/* Get the page directory entry number. */
-	pde = (addr % 0x40000000) / 0x200000;
-
-	/* Get the page table from the page directory. */
-	assert(pdir[pde] & X86_PTE_PRESENT);
-	ptbl = (uint64_t *)P2V((ptr_t)(pdir[pde] & 0x000000FFFFFFF000LL));
-
-	/* Get the page table entry number. */
-	pte = (addr % 0x200000) / PAGE_SIZE;
-
-	/* Get the page from the page table. */
-	assert(ptbl[pte] & X86_PTE_PRESENT);
-	page = P2V((ptr_t)(ptbl[pte] & 0x000000FFFFFFF000LL));
-
-	memcpy(dest, (void *)(ptr_t)(page + addr % PAGE_SIZE), size);
+	while(size) {
+		count = MIN(size, PAGE_SIZE - (addr % PAGE_SIZE));
+		memcpy(dest, translate64(ctx, addr), count);
+		dest += count;
+		addr += count;
+		size -= count;
+	}
 }
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief		x86 SHA-256 acceleration.
+ *
+ * If the CPU supports the SHA extensions, SHA-256 blocks are hashed using
+ * them, which is several times faster than the generic implementation. The
+ * loader is built without SSE and does not normally enable it, so SSE is
+ * enabled around each call to the accelerated transform and the previous
+ * control register state is restored afterwards. Nothing else in the loader
+ * uses the SSE registers, so they do not need to be preserved.
+ */
+
+#include <x86/cpu.h>
+
+#include <lib/sha256.h>
+
+#include <loader.h>
+
+extern void x86_sha256_transform_ni(uint32_t *state, const void *data, size_t blocks);
+
+/** Whether the SHA extensions are supported (-1 if not yet checked). */
+static int sha_ni_supported = -1;
+
+/** Check whether the CPU supports the SHA extensions.
+ * @return		Whether the SHA extensions are supported. */
+static bool check_sha_ni(void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	x86_cpuid(X86_CPUID_VENDOR_ID, &eax, &ebx, &ecx, &edx);
+	if(eax < X86_CPUID_STRUCT_EXT)
+		return false;
+
+	x86_cpuid(X86_CPUID_FEATURE_INFO, &eax, &ebx, &ecx, &edx);
+	if(!(ecx & X86_FEATURE_SSSE3))
+		return false;
+
+	x86_cpuid_count(X86_CPUID_STRUCT_EXT, 0, &eax, &ebx, &ecx, &edx);
+	return ebx & X86_STRUCT_FEATURE_SHA;
+}
+
+/** Hash blocks of data using an accelerated implementation.
+ * @param state		Hash state to update.
+ * @param data		Data to hash.
+ * @param blocks	Number of whole blocks to hash.
+ * @return		Whether the blocks were hashed. If false, the generic
+ *			implementation should be used. */
+bool arch_sha256_transform(uint32_t *state, const void *data, size_t blocks) {
+	unsigned long cr0, cr4;
+
+	if(sha_ni_supported < 0) {
+		sha_ni_supported = check_sha_ni();
+		dprintf("sha256: using %s implementation\n",
+			(sha_ni_supported) ? "SHA-NI" : "generic");
+	}
+
+	if(!sha_ni_supported)
+		return false;
+
+	cr0 = x86_read_cr0();
+	cr4 = x86_read_cr4();
+	x86_write_cr0((cr0 & ~(X86_CR0_EM | X86_CR0_TS)) | X86_CR0_MP);
+	x86_write_cr4(cr4 | X86_CR4_OSFXSR);
+
+	x86_sha256_transform_ni(state, data, blocks);
+
+	x86_write_cr4(cr4);
+	x86_write_cr0(cr0);
+	return true;
+}
@@ -21,6 +21,7 @@
  * @fixme		The parser is a little bit shit...
  */
 
+#include <lib/arena.h>
 #include <lib/ctype.h>
 #include <lib/string.h>
 #include <lib/utility.h>
@@ -493,6 +494,7 @@ static bool config_parse(const char *buf, const char *path) {
  * @return		Whether the file was loaded successfully. */
 static bool config_load(const char *path) {
 	file_handle_t *handle;
+	arena_mark_t mark;
 	size_t size;
 	char *buf;
 	bool ret;
@@ -500,17 +502,20 @@ static bool config_load(const char *path) {
 	if(!(handle = file_open(path, NULL)))
 		return false;
 
+	/* The file data is only needed while parsing, everything that is kept
+	 * is copied out of it. */
+	mark = arena_mark(&scratch_arena);
 	size = file_size(handle);
-	buf = kmalloc(size + 1);
+	buf = arena_alloc(&scratch_arena, size + 1);
 	if(!file_read(handle, buf, size, 0)) {
-		kfree(buf);
+		arena_release(&scratch_arena, mark);
 		file_close(handle);
 		return false;
 	}
 	buf[size] = 0;
 
 	ret = config_parse(buf, path);
-	kfree(buf);
+	arena_release(&scratch_arena, mark);
 	file_close(handle);
 	return ret;
 }
@@ -19,6 +19,7 @@
  * @brief		Filesystem functions.
  */
 
+#include <lib/arena.h>
 #include <lib/string.h>
 #include <lib/utility.h>
 
@@ -26,6 +27,8 @@
 #include <config.h>
 #include <fs.h>
 #include <memory.h>
+#include <time.h>
+#include <verify.h>
 
 #if CONFIG_KBOOT_FS_ZLIB
 # include "fs/decompress.h"
@@ -46,6 +49,14 @@ file_handle_t *file_handle_create(mount_t *mount, bool directory, void *data) {
 	#if CONFIG_KBOOT_FS_ZLIB
 	handle->compressed = NULL;
 	#endif
+	#if CONFIG_KBOOT_PRELOAD
+	handle->preload = NULL;
+	handle->preloaded = 0;
+	list_init(&handle->preload_link);
+	#endif
+	#if CONFIG_KBOOT_VERIFY
+	handle->verify = NULL;
+	#endif
 	return handle;
 }
 
@@ -110,7 +121,8 @@ static bool file_open_cb(const char *name, file_handle_t *handle, void *_data) {
  * @return		Pointer to handle on success, NULL on failure.
  */
 file_handle_t *file_open(const char *path, file_handle_t *from) {
-	char *dup, *orig, *tok;
+	arena_mark_t mark;
+	char *dup, *tok;
 	file_open_data_t data;
 	file_handle_t *handle;
 	mount_t *mount;
@@ -141,20 +153,21 @@ file_handle_t *file_open(const char *path, file_handle_t *from) {
 
 		/* Loop through each element of the path string. The string must be
 		 * duplicated so that it can be modified. */
-		dup = orig = kstrdup(path);
+		mark = arena_mark(&scratch_arena);
+		dup = arena_strdup(&scratch_arena, path);
 		while(true) {
 			tok = strsep(&dup, "/");
 			if(tok == NULL) {
 				/* The last token was the last element of the path
 				 * string, return the node we're currently on. */
-				kfree(orig);
+				arena_release(&scratch_arena, mark);
 				break;
 			} else if(!handle->directory) {
 				/* The previous node was not a directory: this means
 				 * the path string is trying to treat a non-directory
 				 * as a directory. Reject this. */
 				file_close(handle);
-				kfree(orig);
+				arena_release(&scratch_arena, mark);
 				return NULL;
 			} else if(!tok[0]) {
 				/* Zero-length path component, do nothing. */
@@ -166,7 +179,7 @@ file_handle_t *file_open(const char *path, file_handle_t *from) {
 			data.handle = NULL;
 			if(!mount->type->iterate(handle, file_open_cb, &data) || !data.handle) {
 				file_close(handle);
-				kfree(orig);
+				arena_release(&scratch_arena, mark);
 				return NULL;
 			}
 
@@ -189,11 +202,20 @@ file_handle_t *file_open(const char *path, file_handle_t *from) {
  * @param handle	Handle to close. */
 void file_close(file_handle_t *handle) {
 	if(--handle->count == 0) {
+		#if CONFIG_KBOOT_PRELOAD
+		file_preload_release(handle);
+		#endif
+
 		#if CONFIG_KBOOT_FS_ZLIB
 		if(handle->compressed)
 			decompress_close(handle);
 		#endif
 
+		#if CONFIG_KBOOT_VERIFY
+		if(handle->verify)
+			verify_free(handle->verify);
+		#endif
+
 		if(handle->mount->type->close)
 			handle->mount->type->close(handle);
 
@@ -201,6 +223,107 @@ void file_close(file_handle_t *handle) {
 	}
 }
 
+/** Read data from a file.
+ * @param handle	Handle to file to read from.
+ * @param buf		Buffer to read into.
+ * @param count		Number of bytes to read.
+ * @param offset	Offset in the file to read from.
+ * @return		Whether the read was successful. */
+static bool read_data(file_handle_t *handle, void *buf, size_t count, offset_t offset) {
+	#if CONFIG_KBOOT_PRELOAD
+	/* Use preloaded data if the whole range is available. */
+	if(handle->preload && offset + count <= handle->preloaded) {
+		memcpy(buf, handle->preload + offset, count);
+		return true;
+	}
+	#endif
+
+	#if CONFIG_KBOOT_FS_ZLIB
+	if(handle->compressed)
+		return decompress_read(handle, buf, count, offset);
+	#endif
+
+	return handle->mount->type->read(handle, buf, count, offset);
+}
+
+#if CONFIG_KBOOT_VERIFY
+
+/** Add data read from a file to its hash.
+ * @param verify	Verification state for the file.
+ * @param buf		Buffer containing data read.
+ * @param count		Number of bytes read.
+ * @param offset	Offset in the file that the data was read from. */
+static void verify_data(file_verify_t *verify, const void *buf, size_t count, offset_t offset) {
+	verify_expect_t *expect;
+	offset_t from, to;
+	size_t skip;
+	#if CONFIG_KBOOT_HAVE_TRACE
+	uint64_t start = arch_timestamp();
+	#endif
+
+	/* Data must be hashed in order. Anything before the current offset
+	 * has already been hashed, and a gap after it is filled by the caller
+	 * before reading. */
+	if(offset > verify->offset || offset + count <= verify->offset)
+		return;
+
+	skip = verify->offset - offset;
+	sha256_update(&verify->ctx, buf + skip, count - skip);
+
+	/* Compare any data that was read outside of the hashed stream. */
+	LIST_FOREACH(&verify->expected, iter) {
+		expect = list_entry(iter, verify_expect_t, header);
+		from = MAX(expect->offset, verify->offset);
+		to = MIN(expect->offset + expect->size, offset + count);
+
+		if(from < to && memcmp(buf + (size_t)(from - offset),
+			expect->data + (size_t)(from - expect->offset),
+			to - from) != 0)
+		{
+			verify->mismatch = true;
+		}
+	}
+
+	verify->offset = offset + count;
+
+	#if CONFIG_KBOOT_HAVE_TRACE
+	verify->time += arch_timestamp() - start;
+	#endif
+}
+
+/** Hash the part of a file being verified that has not yet been read.
+ * @param handle	Handle to file being verified.
+ * @param end		Offset to hash up to.
+ * @return		Whether the data was read successfully. */
+bool file_verify_fill(file_handle_t *handle, offset_t end) {
+	file_verify_t *verify = handle->verify;
+	arena_mark_t mark;
+	size_t count;
+	bool ret = true;
+	void *buf;
+
+	if(verify->offset >= end)
+		return true;
+
+	mark = arena_mark(&scratch_arena);
+	buf = arena_alloc(&scratch_arena, VERIFY_FILL_SIZE);
+
+	while(verify->offset < end) {
+		count = MIN(end - verify->offset, VERIFY_FILL_SIZE);
+		if(!read_data(handle, buf, count, verify->offset)) {
+			ret = false;
+			break;
+		}
+
+		verify_data(verify, buf, count, verify->offset);
+	}
+
+	arena_release(&scratch_arena, mark);
+	return ret;
+}
+
+#endif /* CONFIG_KBOOT_VERIFY */
+
 /** Read from a file.
  * @param handle	Handle to file to read from.
  * @param buf		Buffer to read into.
@@ -213,12 +336,67 @@ bool file_read(file_handle_t *handle, void *buf, size_t count, offset_t offset)
 	if(!count)
 		return true;
 
-	#if CONFIG_KBOOT_FS_ZLIB
-	if(handle->compressed)
-		return decompress_read(handle, buf, count, offset);
+	#if CONFIG_KBOOT_VERIFY
+	/* If the file is being verified, hash the data as it is read. This is
+	 * done in chunks so that each chunk is hashed while it is still in the
+	 * cache, rather than making a second pass over all of the data. Any
+	 * data before the range being read that has not already been read must
+	 * be hashed first, as the hash must be computed in order. */
+	if(handle->verify) {
+		size_t size;
+
+		if(!file_verify_fill(handle, offset))
+			return false;
+
+		while(count) {
+			size = MIN(count, VERIFY_CHUNK_SIZE);
+			if(!read_data(handle, buf, size, offset))
+				return false;
+
+			verify_data(handle->verify, buf, size, offset);
+			buf += size;
+			offset += size;
+			count -= size;
+		}
+
+		return true;
+	}
 	#endif
 
-	return handle->mount->type->read(handle, buf, count, offset);
+	return read_data(handle, buf, count, offset);
+}
+
+/**
+ * Read from a file ahead of the data being verified.
+ *
+ * Behaves the same as file_read(), except that if the file is being
+ * verified, data past the part that has been hashed so far is not hashed
+ * now, which would mean reading everything before it first. Instead it is
+ * checked against the file contents when they are hashed later on. This
+ * allows headers at the end of a file to be used to decide what to read
+ * from before them, without reading the file out of order.
+ *
+ * @param handle	Handle to file to read from.
+ * @param buf		Buffer to read into.
+ * @param count		Number of bytes to read.
+ * @param offset	Offset in the file to read from.
+ *
+ * @return		Whether the read was successful.
+ */
+bool file_peek(file_handle_t *handle, void *buf, size_t count, offset_t offset) {
+	assert(!handle->directory);
+
+	#if CONFIG_KBOOT_VERIFY
+	if(handle->verify && offset >= handle->verify->offset) {
+		if(!read_data(handle, buf, count, offset))
+			return false;
+
+		verify_expect(handle, buf, count, offset);
+		return true;
+	}
+	#endif
+
+	return file_read(handle, buf, count, offset);
 }
 
 /** Get the size of a file.
@@ -235,6 +413,131 @@ offset_t file_size(file_handle_t *handle) {
 	return handle->mount->type->size(handle);
 }
 
+/** Get the location of a file's data on its disk.
+ * @param handle	Handle to the file.
+ * @return		Byte offset of the start of the file's data on the
+ *			disk, or ~0 if not known. */
+offset_t file_location(file_handle_t *handle) {
+	assert(!handle->directory);
+
+	if(!handle->mount->type->location)
+		return ~(offset_t)0;
+
+	return handle->mount->type->location(handle);
+}
+
+#if CONFIG_KBOOT_PRELOAD
+
+/** List of handles that have a preload buffer. */
+static LIST_DECLARE(preloaded_handles);
+
+/** Total size of all preload buffers. */
+static phys_size_t preloaded_total = 0;
+
+/**
+ * Read part of a file into memory ahead of time.
+ *
+ * Reads the next chunk of a file into a buffer attached to the handle, from
+ * which later reads of the file will be satisfied. This is used to make use
+ * of time that would otherwise be spent idle, such as while the menu is
+ * waiting to time out. The buffer is freed when the handle is closed, or
+ * earlier with file_preload_release(). As everything preloaded will need
+ * to be copied somewhere when it is loaded, files are only preloaded while
+ * at least as much free memory as has been preloaded would remain.
+ *
+ * @param handle	Handle to file to preload.
+ *
+ * @return		Whether there is more of the file left to preload.
+ */
+bool file_preload(file_handle_t *handle) {
+	memory_stats_t stats;
+	phys_size_t alloc;
+	offset_t size;
+	phys_ptr_t phys;
+	size_t count;
+
+	assert(!handle->directory);
+
+	size = file_size(handle);
+	if(handle->preloaded >= size)
+		return false;
+
+	/* Allocate the buffer high up so that it is unlikely to get in the way
+	 * of allocations made when loading. If there is not enough memory,
+	 * give up on preloading this file. */
+	if(!handle->preload) {
+		alloc = ROUND_UP(size, PAGE_SIZE);
+
+		memory_stats(&stats);
+		if(preloaded_total + (alloc * 2) > stats.phys_free
+			|| !phys_memory_alloc(alloc, 0, 0, 0, PHYS_MEMORY_INTERNAL,
+				PHYS_ALLOC_HIGH | PHYS_ALLOC_CANFAIL, &phys))
+		{
+			handle->preloaded = ~(offset_t)0;
+			return false;
+		}
+
+		handle->preload = (void *)P2V(phys);
+		preloaded_total += alloc;
+		list_append(&preloaded_handles, &handle->preload_link);
+	}
+
+	/* This range is not yet preloaded so file_read() will go to the
+	 * filesystem for it. */
+	count = MIN(size - handle->preloaded, FILE_PRELOAD_CHUNK_SIZE);
+	if(!file_read(handle, handle->preload + handle->preloaded, count, handle->preloaded)) {
+		/* Leave the error to be reported by the real read. */
+		file_preload_release(handle);
+		return false;
+	}
+
+	handle->preloaded += count;
+	return handle->preloaded < size;
+}
+
+/**
+ * Free a file's preload buffer.
+ *
+ * Frees the preload buffer for a file, if it has one, and stops any further
+ * preloading of it. This should be done once the file has been loaded, as
+ * the data will not be needed again. Any later reads of the file will go to
+ * the filesystem.
+ *
+ * @param handle	Handle to file.
+ */
+void file_preload_release(file_handle_t *handle) {
+	phys_size_t size;
+
+	if(handle->preload) {
+		size = ROUND_UP(file_size(handle), PAGE_SIZE);
+		phys_memory_add(V2P((ptr_t)handle->preload), size, PHYS_MEMORY_FREE);
+		preloaded_total -= size;
+
+		list_remove(&handle->preload_link);
+		handle->preload = NULL;
+	}
+
+	handle->preloaded = ~(offset_t)0;
+}
+
+/**
+ * Free all preload buffers.
+ *
+ * Frees the preload buffers of all open files. This is used when something
+ * other than what was preloaded is going to be loaded, so that the buffers
+ * do not take up memory that it needs.
+ */
+void file_preload_release_all(void) {
+	file_handle_t *handle;
+
+	LIST_FOREACH_SAFE(&preloaded_handles, iter) {
+		handle = list_entry(iter, file_handle_t, preload_link);
+		file_preload_release(handle);
+	}
+}
+
+#endif /* CONFIG_KBOOT_PRELOAD */
+
 /** Iterate over entries in a directory.
  * @param handle	Handle to directory.
  * @param cb		Callback to call on each entry.
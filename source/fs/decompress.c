@@ -40,19 +40,21 @@
 
 /** Decompression state structure. */
 typedef struct decompress_state {
-	z_stream stream;		/**< Zlib stream. */
 	offset_t output_size;		/**< Total size of the output file. */
 	offset_t output_offset;		/**< Current offset in the output file. */
 	offset_t input_size;		/**< Total size of the input file. */
 	offset_t input_offset;		/**< Current offset in the input file. */
-
-	/** Buffer for data read from the input file. */
-	uint8_t buffer[INPUT_BUFFER_SIZE];
 } decompress_state_t;
 
 /** Currently active decompression state. */
 static decompress_state_t *active_decompress_state = NULL;
 
+/** Zlib stream and input buffer for the active state. Only one file is
+ *  decompressed at a time, so these are shared rather than being part of
+ *  each file's state, which keeps an open compressed file cheap. */
+static z_stream decompress_stream;
+static uint8_t decompress_buffer[INPUT_BUFFER_SIZE];
+
 /** Allocation function for zlib.
  * @param data		Ignored.
  * @param items		Number of items.
@@ -109,8 +111,12 @@ void decompress_open(file_handle_t *handle) {
 void decompress_close(file_handle_t *handle) {
 	decompress_state_t *state = handle->compressed;
 
-	if(state == active_decompress_state)
-		inflateEnd(&state->stream);
+	/* Clear the active state as well, a later handle may be given the same
+	 * address and must not pick up the ended stream. */
+	if(state == active_decompress_state) {
+		inflateEnd(&decompress_stream);
+		active_decompress_state = NULL;
+	}
 
 	kfree(state);
 }
@@ -125,12 +131,12 @@ static bool stream_input(file_handle_t *handle, decompress_state_t *state) {
 	/* Don't read past the end of the file. */
 	count = MIN(state->input_size - state->input_offset, INPUT_BUFFER_SIZE);
 
-	if(!handle->mount->type->read(handle, state->buffer, count, state->input_offset))
+	if(!handle->mount->type->read(handle, decompress_buffer, count, state->input_offset))
 		return false;
 
 	state->input_offset += count;
-	state->stream.next_in = state->buffer;
-	state->stream.avail_in = count;
+	decompress_stream.next_in = decompress_buffer;
+	decompress_stream.avail_in = count;
 	return true;
 }
 
@@ -143,20 +149,20 @@ static bool stream_input(file_handle_t *handle, decompress_state_t *state) {
 static bool stream_output(file_handle_t *handle, decompress_state_t *state, void *buf, size_t count) {
 	int ret;
 
-	state->stream.next_out = buf;
-	state->stream.avail_out = count;
+	decompress_stream.next_out = buf;
+	decompress_stream.avail_out = count;
 
 	do {
 		/* Make sure we have input available. */
-		if(!state->stream.avail_in && !stream_input(handle, state))
+		if(!decompress_stream.avail_in && !stream_input(handle, state))
 			return false;
 
-		ret = inflate(&state->stream, Z_NO_FLUSH);
+		ret = inflate(&decompress_stream, Z_NO_FLUSH);
 		if(ret == Z_DATA_ERROR)
 			return false;
-	} while(state->stream.avail_out && ret != Z_STREAM_END);
+	} while(decompress_stream.avail_out && ret != Z_STREAM_END);
 
-	if(state->stream.avail_out)
+	if(decompress_stream.avail_out)
 		return false;
 
 	state->output_offset += count;
@@ -184,18 +190,18 @@ bool decompress_read(file_handle_t *handle, void *buf, size_t count, offset_t of
 	 * to avoid using too much heap space. */
 	if(state != active_decompress_state) {
 		if(active_decompress_state)
-			inflateEnd(&active_decompress_state->stream);
+			inflateEnd(&decompress_stream);
 
 		state->output_offset = 0;
 		state->input_offset = 0;
 
 		/* Initialize zlib state. */
-		state->stream.zalloc = zlib_alloc;
-		state->stream.zfree = zlib_free;
-		state->stream.opaque = NULL;
-		state->stream.next_in = NULL;
-		state->stream.avail_in = 0;
-		ret = inflateInit2(&state->stream, 15 + 16);
+		decompress_stream.zalloc = zlib_alloc;
+		decompress_stream.zfree = zlib_free;
+		decompress_stream.opaque = NULL;
+		decompress_stream.next_in = NULL;
+		decompress_stream.avail_in = 0;
+		ret = inflateInit2(&decompress_stream, 15 + 16);
 		if(ret != Z_OK) {
 			dprintf("fs: failed to initialize zlib: %d\n", ret);
 			return false;
@@ -206,10 +212,10 @@ bool decompress_read(file_handle_t *handle, void *buf, size_t count, offset_t of
 
 	if(state->output_offset > offset) {
 		/* Return to the beginning of the stream. */
-		inflateReset(&state->stream);
+		inflateReset(&decompress_stream);
 		state->output_offset = 0;
 		state->input_offset = 0;
-		state->stream.avail_in = 0;
+		decompress_stream.avail_in = 0;
 	}
 
 	/* Read in bytes until we reach the desired position. */
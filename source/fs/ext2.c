@@ -19,6 +19,7 @@
  * @brief		Ext2 filesystem support.
  */
 
+#include <lib/arena.h>
 #include <lib/string.h>
 #include <lib/utility.h>
 
@@ -97,17 +98,18 @@ static ext4_extent_header_t *ext4_find_leaf(mount_t *mount, ext4_extent_header_t
  * @param nump		Where to store raw block number.
  * @return		Whether successful. */
 static bool ext2_inode_block_get(file_handle_t *handle, uint32_t block, uint32_t *nump) {
-	uint32_t *i_block = NULL, *bi_block = NULL, num;
+	arena_mark_t mark = arena_mark(&scratch_arena);
 	ext2_mount_t *mount = handle->mount->data;
 	ext2_inode_t *inode = handle->data;
+	uint32_t *i_block, *bi_block, num;
 	ext4_extent_header_t *header;
 	ext4_extent_t *extent;
-	void *buf = NULL;
 	bool ret = false;
+	void *buf;
 	uint16_t i;
 
 	if(le32_to_cpu(inode->i_flags) & EXT4_EXTENTS_FL) {
-		buf = kmalloc(mount->block_size);
+		buf = arena_alloc(&scratch_arena, mount->block_size);
 		header = ext4_find_leaf(handle->mount, (ext4_extent_header_t *)inode->i_block, block, buf);
 		if(!header)
 			goto out;
@@ -140,7 +142,7 @@ static bool ext2_inode_block_get(file_handle_t *handle, uint32_t block, uint32_t
 		}
 
 		block -= EXT2_NDIR_BLOCKS;
-		i_block = kmalloc(mount->block_size);
+		i_block = arena_alloc(&scratch_arena, mount->block_size);
 
 		/* Check whether the indirect block contains the block number
 		 * we need. The indirect block contains as many 32-bit entries
@@ -161,7 +163,7 @@ static bool ext2_inode_block_get(file_handle_t *handle, uint32_t block, uint32_t
 		}
 
 		block -= mount->block_size / sizeof(uint32_t);
-		bi_block = kmalloc(mount->block_size);
+		bi_block = arena_alloc(&scratch_arena, mount->block_size);
 
 		/* Not in the indirect block, check the bi-indirect blocks. The
 		 * bi-indirect block contains as many 32-bit entries as will
@@ -198,9 +200,7 @@ static bool ext2_inode_block_get(file_handle_t *handle, uint32_t block, uint32_t
 		goto out;
 	}
 out:
-	kfree(bi_block);
-	kfree(i_block);
-	kfree(buf);
+	arena_release(&scratch_arena, mark);
 	return ret;
 }
 
@@ -378,14 +378,16 @@ static void ext2_close(file_handle_t *handle) {
  * @param offset	Offset into the file.
  * @return		Whether read successfully. */
 static bool ext2_read(file_handle_t *handle, void *buf, size_t count, offset_t offset) {
+	arena_mark_t mark = arena_mark(&scratch_arena);
 	ext2_mount_t *mount = handle->mount->data;
 	size_t blksize = mount->block_size;
 	uint32_t start, end, i, size;
 	void *block = NULL;
+	bool ret = false;
 
 	/* Allocate a temporary buffer for partial transfers if required. */
 	if(offset % blksize || count % blksize)
-		block = kmalloc(blksize);
+		block = arena_alloc(&scratch_arena, blksize);
 
 	/* Now work out the start block and the end block. Subtract one from
 	 * count to prevent end from going onto the next block when the offset
@@ -398,10 +400,8 @@ static bool ext2_read(file_handle_t *handle, void *buf, size_t count, offset_t o
 	 * If the transfer only goes across one block, this will handle it. */
 	if(offset % blksize) {
 		/* Read the block into the temporary buffer. */
-		if(!ext2_inode_block_read(handle, block, start)) {
-			kfree(block);
-			return false;
-		}
+		if(!ext2_inode_block_read(handle, block, start))
+			goto out;
 
 		size = (start == end) ? count : blksize - (size_t)(offset % blksize);
 		memcpy(buf, block + (offset % blksize), size);
@@ -412,24 +412,22 @@ static bool ext2_read(file_handle_t *handle, void *buf, size_t count, offset_t o
 	size = count / blksize;
 	for(i = 0; i < size; i++, buf += blksize, count -= blksize, start++) {
 		/* Read directly into the destination buffer. */
-		if(!ext2_inode_block_read(handle, buf, start)) {
-			kfree(block);
-			return false;
-		}
+		if(!ext2_inode_block_read(handle, buf, start))
+			goto out;
 	}
 
 	/* Handle anything that's left. */
 	if(count > 0) {
-		if(!ext2_inode_block_read(handle, block, start)) {
-			kfree(block);
-			return false;
-		}
+		if(!ext2_inode_block_read(handle, block, start))
+			goto out;
 
 		memcpy(buf, block, count);
 	}
 
-	kfree(block);
-	return true;
+	ret = true;
+out:
+	arena_release(&scratch_arena, mark);
+	return ret;
 }
 
 /** Get the size of a file.
@@ -440,22 +438,38 @@ static offset_t ext2_size(file_handle_t *handle) {
 	return le32_to_cpu(inode->i_size);
 }
 
+/** Get the location of a file's data on the disk.
+ * @param handle	Handle to the file.
+ * @return		Byte offset of the file's first block on the disk, or
+ *			~0 if not known. */
+static offset_t ext2_location(file_handle_t *handle) {
+	ext2_mount_t *mount = handle->mount->data;
+	ext2_inode_t *inode = handle->data;
+	uint32_t raw = 0;
+
+	if(!le32_to_cpu(inode->i_size) || !ext2_inode_block_get(handle, 0, &raw) || !raw)
+		return ~(offset_t)0;
+
+	return (offset_t)raw * mount->block_size;
+}
+
 /** Iterate over directory entries.
  * @param handle	Handle to directory.
  * @param cb		Callback to call on each entry.
  * @param arg		Data to pass to callback.
  * @return		Whether read successfully. */
 static bool ext2_iterate(file_handle_t *handle, dir_iterate_cb_t cb, void *arg) {
+	arena_mark_t mark = arena_mark(&scratch_arena);
 	ext2_inode_t *inode = handle->data;
-	char *buf = NULL, *name = NULL;
 	ext2_dirent_t *dirent;
 	uint32_t current = 0;
 	file_handle_t *child;
 	bool ret = false;
+	char *buf, *name;
 
 	/* Allocate buffers to read the data into. */
-	buf = kmalloc(le32_to_cpu(inode->i_size));
-	name = kmalloc(EXT2_NAME_MAX + 1);
+	buf = arena_alloc(&scratch_arena, le32_to_cpu(inode->i_size));
+	name = arena_alloc(&scratch_arena, EXT2_NAME_MAX + 1);
 
 	/* Read in all the directory entries required. */
 	if(!ext2_read(handle, buf, le32_to_cpu(inode->i_size), 0))
@@ -487,8 +501,7 @@ static bool ext2_iterate(file_handle_t *handle, dir_iterate_cb_t cb, void *arg)
 
 	ret = true;
 out:
-	kfree(buf);
-	kfree(name);
+	arena_release(&scratch_arena, mark);
 	return ret;
 }
 
@@ -498,5 +511,6 @@ BUILTIN_FS_TYPE(ext2_fs_type) = {
 	.close = ext2_close,
 	.read = ext2_read,
 	.size = ext2_size,
+	.location = ext2_location,
 	.iterate = ext2_iterate,
 };
@@ -320,6 +320,14 @@ static offset_t iso9660_size(file_handle_t *handle) {
 	return data->data_len;
 }
 
+/** Get the location of an ISO9660 file's data on the disk.
+ * @param handle	Handle to the file.
+ * @return		Byte offset of the file's extent on the disk. */
+static offset_t iso9660_location(file_handle_t *handle) {
+	iso9660_handle_t *data = handle->data;
+	return (offset_t)data->extent * ISO9660_BLOCK_SIZE;
+}
+
 /** Iterate over directory entries.
  * @param handle	Handle to directory.
  * @param cb		Callback to call on each entry.
@@ -385,5 +393,6 @@ BUILTIN_FS_TYPE(iso9660_fs_type) = {
 	.close = iso9660_close,
 	.read = iso9660_read,
 	.size = iso9660_size,
+	.location = iso9660_location,
 	.iterate = iso9660_iterate,
 };
@@ -572,32 +572,46 @@ typedef struct {
 	Elf64_Word n_type;			/**< Type of the note. */
 } __packed Elf64_Note;
 
-/** Check whether a file is a certain ELF type.
- * @param handle	Handle to file to check.
+/** Check whether an ELF header is a certain ELF type.
+ * @param _ehdr		ELF header to check. Only fields which are the same
+ *			for ELF32 and ELF64 are used, so this can be either.
  * @param bitsize	ELF class definition.
  * @param endian	ELF endian definition (or 0).
  * @param machine	ELF machine definition (or 0).
- * @return		Whether the file is this type. */
-static inline bool elf_check(file_handle_t *handle, uint8_t bitsize, uint8_t endian, uint8_t machine) {
-	Elf32_Ehdr ehdr;
+ * @return		Whether the header is this type. */
+static inline bool elf_header_check(const void *_ehdr, uint8_t bitsize, uint8_t endian, uint8_t machine) {
+	const Elf32_Ehdr *ehdr = _ehdr;
 
-	if(!file_read(handle, &ehdr, sizeof(ehdr), 0)) {
-		boot_error("Could not read kernel image");
-	} else if(strncmp((const char *)ehdr.e_ident, ELF_MAGIC, 4) != 0) {
+	if(strncmp((const char *)ehdr->e_ident, ELF_MAGIC, 4) != 0) {
 		return false;
-	} else if(ehdr.e_ident[ELF_EI_VERSION] != 1 || ehdr.e_version != 1) {
+	} else if(ehdr->e_ident[ELF_EI_VERSION] != 1 || ehdr->e_version != 1) {
 		return false;
-	} else if(ehdr.e_ident[ELF_EI_CLASS] != bitsize) {
+	} else if(ehdr->e_ident[ELF_EI_CLASS] != bitsize) {
 		return false;
-	} else if(endian != 0 && ehdr.e_ident[ELF_EI_DATA] != endian) {
+	} else if(endian != 0 && ehdr->e_ident[ELF_EI_DATA] != endian) {
 		return false;
-	} else if(machine != 0 && ehdr.e_machine != machine) {
+	} else if(machine != 0 && ehdr->e_machine != machine) {
 		return false;
-	} else if(ehdr.e_type != ELF_ET_EXEC) {
+	} else if(ehdr->e_type != ELF_ET_EXEC) {
 		return false;
 	}
 
 	return true;
 }
 
+/** Check whether a file is a certain ELF type.
+ * @param handle	Handle to file to check.
+ * @param bitsize	ELF class definition.
+ * @param endian	ELF endian definition (or 0).
+ * @param machine	ELF machine definition (or 0).
+ * @return		Whether the file is this type. */
+static inline bool elf_check(file_handle_t *handle, uint8_t bitsize, uint8_t endian, uint8_t machine) {
+	Elf32_Ehdr ehdr;
+
+	if(!file_read(handle, &ehdr, sizeof(ehdr), 0))
+		boot_error("Could not read kernel image");
+
+	return elf_header_check(&ehdr, bitsize, endian, machine);
+}
+
 #endif /* __ELF_H */
@@ -25,8 +25,9 @@
 #include <disk.h>
 #include <loader.h>
 
-struct mount;
 struct file_handle;
+struct file_verify;
+struct mount;
 
 /** Type of a dir_iterate() callback.
  * @param name		Name of the entry.
@@ -68,6 +69,14 @@ typedef struct fs_type {
 	 * @return		Size of the file. */
 	offset_t (*size)(struct file_handle *handle);
 
+	/** Get the location of a file's data on the disk.
+	 * @note		Optional. Only used as a hint to order reads
+	 *			of multiple files to reduce seeking.
+	 * @param handle	Handle to the file.
+	 * @return		Byte offset of the start of the file's data on
+	 *			the disk, or ~0 if not known. */
+	offset_t (*location)(struct file_handle *handle);
+
 	/** Iterate over directory entries.
 	 * @param handle	Handle to directory.
 	 * @param cb		Callback to call on each entry.
@@ -103,8 +112,19 @@ typedef struct file_handle {
 	#if CONFIG_KBOOT_FS_ZLIB
 	void *compressed;		/**< If the file is compressed, pointer to decompress data. */
 	#endif
+	#if CONFIG_KBOOT_PRELOAD
+	void *preload;			/**< Buffer containing preloaded file data. */
+	offset_t preloaded;		/**< Amount of data that has been preloaded. */
+	list_t preload_link;		/**< Link to list of preloaded handles. */
+	#endif
+	#if CONFIG_KBOOT_VERIFY
+	struct file_verify *verify;	/**< If being verified, verification state. */
+	#endif
 } file_handle_t;
 
+/** Amount of data to read in each file_preload() call. */
+#define FILE_PRELOAD_CHUNK_SIZE	0x20000
+
 extern file_handle_t *file_handle_create(mount_t *mount, bool directory, void *data);
 
 #if CONFIG_KBOOT_HAVE_DISK
@@ -114,7 +134,19 @@ extern mount_t *fs_probe(disk_t *disk);
 extern file_handle_t *file_open(const char *path, file_handle_t *from);
 extern void file_close(file_handle_t *handle);
 extern bool file_read(file_handle_t *handle, void *buf, size_t count, offset_t offset);
+extern bool file_peek(file_handle_t *handle, void *buf, size_t count, offset_t offset);
 extern offset_t file_size(file_handle_t *handle);
+extern offset_t file_location(file_handle_t *handle);
+
+#if CONFIG_KBOOT_PRELOAD
+extern bool file_preload(file_handle_t *handle);
+extern void file_preload_release(file_handle_t *handle);
+extern void file_preload_release_all(void);
+#endif
+
+#if CONFIG_KBOOT_VERIFY
+extern bool file_verify_fill(file_handle_t *handle, offset_t end);
+#endif
 
 extern bool dir_iterate(file_handle_t *handle, dir_iterate_cb_t cb, void *arg);
 
@@ -61,6 +61,8 @@ typedef struct kboot_tag {
 #define KBOOT_TAG_LOG			9	/**< Kernel log buffer. */
 #define KBOOT_TAG_SECTIONS		10	/**< ELF section information. */
 #define KBOOT_TAG_E820			11	/**< BIOS address range descriptor (PC-specific). */
+#define KBOOT_TAG_MEMSTATS		12	/**< Boot loader memory usage statistics. */
+#define KBOOT_TAG_TIMING		13	/**< Boot phase timestamps. */
 
 /** Tag containing core information for the kernel. */
 typedef struct kboot_tag_core {
@@ -300,6 +302,44 @@ typedef struct kboot_tag_e820 {
 	uint32_t attr;
 } kboot_tag_e820_t;
 
+/** Tag containing boot loader memory usage statistics. */
+typedef struct kboot_tag_memstats {
+	kboot_tag_t header;			/**< Tag header. */
+
+	uint32_t heap_size;			/**< Total size of the loader heap. */
+	uint32_t heap_current;			/**< Heap space in use when the kernel was entered. */
+	uint32_t heap_peak;			/**< Peak heap space in use. */
+	uint32_t heap_largest;			/**< Largest free heap block. */
+	uint32_t heap_allocs;			/**< Number of heap allocations made. */
+	uint32_t heap_frees;			/**< Number of heap allocations freed. */
+
+	uint64_t phys_allocated;		/**< Total physical memory allocated. */
+	uint32_t phys_allocs;			/**< Number of physical memory allocations. */
+	uint32_t _pad;
+} kboot_tag_memstats_t;
+
+/** Tag containing boot phase timestamps. */
+typedef struct kboot_tag_timing {
+	kboot_tag_t header;			/**< Tag header. */
+
+	uint64_t frequency;			/**< Frequency of the timestamp counter (Hz). */
+	uint32_t count;				/**< Number of timestamps. */
+	uint32_t _pad;
+
+	uint64_t timestamps[0];			/**< Timestamp at the start of each phase. */
+} kboot_tag_timing_t;
+
+/** Boot phases recorded in the timing tag. */
+#define KBOOT_TIMING_ENTRY		0	/**< Loader entry. */
+#define KBOOT_TIMING_MEMORY		1	/**< Memory detection started. */
+#define KBOOT_TIMING_DISK		2	/**< Disk probing started. */
+#define KBOOT_TIMING_CONFIG		3	/**< Configuration loading started. */
+#define KBOOT_TIMING_MENU		4	/**< Menu displayed. */
+#define KBOOT_TIMING_KERNEL		5	/**< Kernel load started. */
+#define KBOOT_TIMING_MMU		6	/**< Page table setup started. */
+#define KBOOT_TIMING_MODULES		7	/**< Module load started. */
+#define KBOOT_TIMING_HANDOFF		8	/**< Entering the kernel. */
+
 /** Tag containing page table information. */
 typedef struct kboot_tag_pagetables {
 	kboot_tag_t header;			/**< Tag header. */
@@ -336,6 +376,7 @@ typedef struct kboot_tag_pagetables {
 #define KBOOT_ITAG_OPTION		2	/**< Option description. */
 #define KBOOT_ITAG_MAPPING		3	/**< Virtual memory mapping description. */
 #define KBOOT_ITAG_VIDEO		4	/**< Requested video mode. */
+#define KBOOT_ITAG_SHA256		5	/**< Expected module digest. */
 
 /** Image tag containing basic image information. */
 typedef struct kboot_itag_image {
@@ -512,5 +553,27 @@ typedef struct kboot_itag_video {
 		"3: .p2align 2\n" \
 		"   .popsection\n")
 
+/** Image tag giving the expected SHA-256 digest of a module. */
+typedef struct kboot_itag_sha256 {
+	uint32_t name_len;			/**< Length of the module name. */
+	char digest[65];			/**< Digest as a hexadecimal string. */
+} kboot_itag_sha256_t;
+
+/** Macro to declare a module digest itag. */
+#define KBOOT_MODULE_SHA256(name, digest) \
+	__asm__( \
+		"   .pushsection \".note.kboot.sha256." name "\", \"a\", " KBOOT_SECTION_TYPE "\n" \
+		"   .long 1f - 0f\n" \
+		"   .long 4f - 2f\n" \
+		"   .long " XSTRINGIFY(KBOOT_ITAG_SHA256) "\n" \
+		"0: .asciz \"KBoot\"\n" \
+		"1: .p2align 2\n" \
+		"2: .long 4f - 3f\n" \
+		"   .asciz \"" digest "\"\n" \
+		"   .p2align 2\n" \
+		"3: .asciz \"" name "\"\n" \
+		"4: .p2align 2\n" \
+		"   .popsection\n")
+
 #endif /* __ASM__ */
 #endif /* __KBOOT_H */
@@ -22,15 +22,24 @@
 #ifndef __LIB_ALLOCATOR_H
 #define __LIB_ALLOCATOR_H
 
-#include <lib/list.h>
-
 #include <target.h>
 
+/** Tree link used by the allocator. */
+typedef struct allocator_link {
+	struct allocator_link *parent;	/**< Parent node. */
+	struct allocator_link *left;	/**< Left child. */
+	struct allocator_link *right;	/**< Right child. */
+	int height;			/**< Height of the subtree. */
+} allocator_link_t;
+
 /** Structure containing a virtual region allocator. */
 typedef struct allocator {
 	target_ptr_t start;		/**< Start of the region that the allocator manages. */
 	target_size_t size;		/**< Size of the region that the allocator manages. */
-	list_t regions;			/**< List of regions. */
+	allocator_link_t *addr_tree;	/**< Free ranges, ordered by address. */
+	allocator_link_t *size_tree;	/**< Free ranges, ordered by size. */
+	size_t count;			/**< Number of free ranges. */
+	struct allocator_range *unused;	/**< Unused range structures. */
 } allocator_t;
 
 extern bool allocator_alloc(allocator_t *alloc, target_size_t size, target_size_t align,
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Arena allocator.
+ */
+
+#ifndef __LIB_ARENA_H
+#define __LIB_ARENA_H
+
+#include <types.h>
+
+struct arena_block;
+
+/** Structure containing an arena allocator. */
+typedef struct arena {
+	struct arena_block *current;	/**< Block currently being allocated from. */
+	size_t offset;			/**< Offset of next allocation in current block. */
+	struct arena_block *spare;	/**< Spare block kept for reuse. */
+} arena_t;
+
+/** Type of a saved arena position. */
+typedef struct arena_mark {
+	struct arena_block *block;	/**< Block at time of marking. */
+	size_t offset;			/**< Offset at time of marking. */
+} arena_mark_t;
+
+/** Initializer for an arena. */
+#define ARENA_INITIALIZER	{ NULL, 0, NULL }
+
+extern arena_t scratch_arena;
+
+extern void *arena_alloc(arena_t *arena, size_t size);
+extern char *arena_strdup(arena_t *arena, const char *str);
+
+/** Save the current position of an arena.
+ * @param arena		Arena to mark.
+ * @return		Saved position, to pass to arena_release(). */
+static inline arena_mark_t arena_mark(arena_t *arena) {
+	arena_mark_t mark = { arena->current, arena->offset };
+	return mark;
+}
+
+extern void arena_release(arena_t *arena, arena_mark_t mark);
+
+#endif /* __LIB_ARENA_H */
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief		SHA-256 hash function.
+ */
+
+#ifndef __LIB_SHA256_H
+#define __LIB_SHA256_H
+
+#include <types.h>
+
+/** Size of a SHA-256 digest. */
+#define SHA256_DIGEST_SIZE	32
+
+/** Size of a SHA-256 input block. */
+#define SHA256_BLOCK_SIZE	64
+
+/** Structure containing SHA-256 hashing state. */
+typedef struct sha256_context {
+	uint32_t state[8];		/**< Current hash state. */
+	uint64_t length;		/**< Total number of bytes hashed. */
+	uint8_t buf[SHA256_BLOCK_SIZE];	/**< Buffer for a partial block. */
+	size_t buf_len;			/**< Number of bytes in the buffer. */
+} sha256_context_t;
+
+#if CONFIG_KBOOT_HAVE_ARCH_SHA256
+extern bool arch_sha256_transform(uint32_t *state, const void *data, size_t blocks);
+#endif
+
+extern void sha256_init(sha256_context_t *ctx);
+extern void sha256_update(sha256_context_t *ctx, const void *data, size_t size);
+extern void sha256_final(sha256_context_t *ctx, uint8_t *digest);
+
+#endif /* __LIB_SHA256_H */
@@ -71,6 +71,15 @@ typedef struct loader_type {
 	 * @return		Pointer to configuration window. */
 	struct ui_window *(*configure)(void);
 	#endif
+
+	#if CONFIG_KBOOT_PRELOAD
+	/** Preload part of the OS while waiting for the menu to time out.
+	 * @note		Optional. Should only do a small amount of work
+	 *			each call so that the menu stays responsive,
+	 *			and must not raise boot errors.
+	 * @return		Whether there is more to preload. */
+	bool (*preload)(void);
+	#endif
 } loader_type_t;
 
 /** Builtin object definition structure. */
@@ -33,18 +33,27 @@
 
 /** Data for the KBoot loader. */
 typedef struct kboot_loader {
+	char *path;			/**< Path to the kernel image. */
 	file_handle_t *kernel;		/**< Handle to the kernel image. */
 	value_t modules;		/**< Modules to load. */
+	list_t module_list;		/**< Modules to load, in the order specified. */
+	struct kboot_module **module_order; /**< Modules in the order to load them in. */
+	size_t module_count;		/**< Number of modules to load. */
 
 	/** Kernel image information. */
 	target_type_t target;		/**< Target operation mode of the kernel. */
 	list_t itags;			/**< Image tag list. */
 	kboot_itag_image_t *image;	/**< Image definition tag. */
 	uint32_t log_magic;		/**< Magic number for the log buffer. */
+	target_size_t large_page_size;	/**< Large page size for the target (0 if none). */
+	void *ehdr;			/**< Cached ELF header. */
+	void *phdrs;			/**< Cached ELF program headers. */
+	void *notes;			/**< Cached contents of ELF note segments. */
 
 	/** Environment for the kernel. */
 	target_ptr_t entry;		/**< Kernel entry point. */
 	phys_ptr_t tags_phys;		/**< Physical address of tag list. */
+	size_t tags_capacity;		/**< Allocated size of tag list. */
 	target_ptr_t tags_virt;		/**< Virtual address of tag list. */
 	mmu_context_t *mmu;		/**< MMU context for the kernel. */
 	allocator_t alloc;		/**< Virtual address space allocator. */
@@ -107,7 +116,8 @@ extern kboot_vaddr_t kboot_allocate_virtual(kboot_loader_t *loader, kboot_paddr_
 extern void kboot_map_virtual(kboot_loader_t *loader, kboot_vaddr_t addr,
 	kboot_paddr_t phys, kboot_vaddr_t size);
 
-extern bool kboot_elf_note_iterate(kboot_loader_t *loader, kboot_note_cb_t cb);
+extern bool kboot_elf_read_headers(kboot_loader_t *loader);
+extern void kboot_elf_note_iterate(kboot_loader_t *loader, kboot_note_cb_t cb);
 extern void kboot_elf_load_kernel(kboot_loader_t *loader, kboot_itag_load_t *load);
 extern void kboot_elf_load_sections(kboot_loader_t *loader);
 
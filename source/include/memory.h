@@ -37,6 +37,23 @@ typedef struct memory_range {
 
 extern list_t memory_ranges;
 
+/** Structure containing memory usage statistics. */
+typedef struct memory_stats {
+	size_t heap_size;		/**< Total size of the heap. */
+	size_t heap_current;		/**< Heap space currently in use. */
+	size_t heap_peak;		/**< Peak heap space in use. */
+	size_t heap_largest;		/**< Largest free heap block. */
+	size_t heap_free_chunks;	/**< Number of free heap blocks. */
+	unsigned heap_fragmentation;	/**< Heap fragmentation (percentage). */
+	unsigned heap_allocs;		/**< Number of heap allocations. */
+	unsigned heap_frees;		/**< Number of heap frees. */
+
+	phys_size_t phys_allocated;	/**< Physical memory allocated. */
+	phys_size_t phys_internal;	/**< Physical memory marked as internal. */
+	phys_size_t phys_free;		/**< Physical memory currently free. */
+	unsigned phys_allocs;		/**< Number of physical allocations. */
+} memory_stats_t;
+
 /** Physical memory range types.
  * @note		These should be the same as the KBoot definitions. */
 #define PHYS_MEMORY_FREE	0
@@ -59,6 +76,12 @@ extern void phys_memory_add(phys_ptr_t start, phys_size_t size, unsigned type);
 extern void phys_memory_protect(phys_ptr_t start, phys_size_t size);
 extern bool phys_memory_alloc(phys_size_t size, phys_size_t align, phys_ptr_t min_addr,
 	phys_ptr_t max_addr, unsigned type, unsigned flags, phys_ptr_t *physp);
+extern bool phys_memory_alloc_offset(phys_size_t size, phys_size_t align, phys_size_t offset,
+	phys_ptr_t min_addr, phys_ptr_t max_addr, unsigned type, unsigned flags,
+	phys_ptr_t *physp);
+
+extern void memory_stats(memory_stats_t *statsp);
+extern void memory_stats_dump(void);
 
 extern void memory_init(void);
 extern void memory_finalize(void);
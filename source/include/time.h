@@ -39,4 +39,7 @@
 
 extern void spin(timeout_t us);
 
+extern uint64_t arch_timestamp(void);
+extern uint64_t arch_timestamp_frequency(void);
+
 #endif /* __TIME_H */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Boot phase tracing.
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <types.h>
+
+/** Phases of the boot process, in the order that they start (must match
+ *  KBOOT_TIMING_* in kboot.h). Each phase lasts until the next one that is
+ *  recorded starts. */
+typedef enum trace_phase {
+	TRACE_PHASE_ENTRY,		/**< Loader entry. */
+	TRACE_PHASE_MEMORY,		/**< Memory detection started. */
+	TRACE_PHASE_DISK,		/**< Disk probing started. */
+	TRACE_PHASE_CONFIG,		/**< Configuration loading started. */
+	TRACE_PHASE_MENU,		/**< Menu displayed. */
+	TRACE_PHASE_KERNEL,		/**< Kernel load started. */
+	TRACE_PHASE_MMU,		/**< Page table setup started. */
+	TRACE_PHASE_MODULES,		/**< Module load started. */
+	TRACE_PHASE_HANDOFF,		/**< Entering the kernel. */
+	TRACE_PHASE_COUNT,		/**< Number of phases. */
+} trace_phase_t;
+
+#if CONFIG_KBOOT_HAVE_TRACE
+
+extern void trace_phase(trace_phase_t phase);
+extern uint64_t trace_timestamp(trace_phase_t phase);
+extern uint64_t trace_frequency(void);
+
+#else
+
+/** Record the start of a boot phase (tracing not supported).
+ * @param phase		Phase that is starting. */
+static inline void trace_phase(trace_phase_t phase) {}
+
+#endif /* CONFIG_KBOOT_HAVE_TRACE */
+#endif /* __TRACE_H */
@@ -97,7 +97,14 @@ typedef struct ui_entry {
 } ui_entry_t;
 
 extern void ui_window_init(ui_window_t *window, ui_window_type_t *type, const char *title);
+/** Type of a function to call while a window is waiting to time out.
+ * @return		Whether there is more work to do. */
+typedef bool (*ui_idle_func_t)(void);
+
 extern void ui_window_display(ui_window_t *window, int timeout);
+#if CONFIG_KBOOT_PRELOAD
+extern void ui_window_display_idle(ui_window_t *window, int timeout, ui_idle_func_t idle);
+#endif
 
 extern ui_window_t *ui_textview_create(const char *title, const char *buf, size_t size,
 	size_t start, size_t length);
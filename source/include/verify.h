@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief		File verification functions.
+ */
+
+#ifndef __VERIFY_H
+#define __VERIFY_H
+
+#include <lib/list.h>
+#include <lib/sha256.h>
+
+#include <fs.h>
+
+/** Data read from a file outside of the hashed stream. */
+typedef struct verify_expect {
+	list_t header;			/**< Link to expected data list. */
+	offset_t offset;		/**< Offset in the file of the data. */
+	size_t size;			/**< Size of the data. */
+	uint8_t data[];			/**< Copy of the data. */
+} verify_expect_t;
+
+/** Structure containing verification state for a file. */
+typedef struct file_verify {
+	sha256_context_t ctx;		/**< Hash of the data read so far. */
+	offset_t offset;		/**< Amount of the file that has been hashed. */
+	uint64_t time;			/**< Time spent hashing (in timestamp ticks). */
+	uint8_t digest[SHA256_DIGEST_SIZE]; /**< Expected digest. */
+	list_t expected;		/**< Data to compare against when hashed. */
+	bool mismatch;			/**< Whether any expected data differed. */
+} file_verify_t;
+
+/** Size of chunks to hash data in as it is read (should fit in the cache). */
+#define VERIFY_CHUNK_SIZE	0x10000
+
+/** Size of chunks to read to hash data that has not been read by the loader. */
+#define VERIFY_FILL_SIZE	0x4000
+
+#if CONFIG_KBOOT_VERIFY
+
+extern bool verify_digest_parse(const char *str, uint8_t *digest);
+extern void verify_begin(file_handle_t *handle, const char *path, const char *digest);
+extern void verify_expect(file_handle_t *handle, const void *data, size_t size, offset_t offset);
+extern void verify_end(file_handle_t *handle, const char *name);
+extern void verify_free(file_verify_t *verify);
+
+#else
+
+/** Start verifying a file (verification not enabled).
+ * @param handle	Handle to file.
+ * @param path		Path that the file was opened with.
+ * @param digest	Expected digest from the image, if any. */
+static inline void verify_begin(file_handle_t *handle, const char *path, const char *digest) {}
+
+/** Check data against a file when it is hashed (verification not enabled).
+ * @param handle	Handle to file.
+ * @param data		Data read from the file.
+ * @param size		Size of the data.
+ * @param offset	Offset in the file that the data was read from. */
+static inline void verify_expect(file_handle_t *handle, const void *data, size_t size, offset_t offset) {}
+
+/** Finish verifying a file (verification not enabled).
+ * @param handle	Handle to file.
+ * @param name		Name of the file for error messages. */
+static inline void verify_end(file_handle_t *handle, const char *name) {}
+
+#endif /* CONFIG_KBOOT_VERIFY */
+#endif /* __VERIFY_H */
@@ -17,6 +17,22 @@
 /**
  * @file
  * @brief		Virtual memory region allocator.
+ *
+ * Space is never freed once it has been allocated, so the allocator only
+ * tracks the free ranges remaining: everything else within the managed region
+ * is allocated. Free ranges are never adjacent to each other, as they can only
+ * shrink or be split. Each range is linked into two AVL trees, one ordered by
+ * address, used to look up the range containing an address, and one ordered
+ * by size (then address), used to find the best fit for an allocation. All
+ * operations are O(log n) in the number of free ranges.
+ *
+ * Range ends are stored inclusively so that an allocator covering the entire
+ * address space can be represented.
+ *
+ * A kernel can have thousands of fixed mappings, each of which can split a
+ * range, which is far more than would fit on the heap. Range structures are
+ * therefore allocated from whole pages of internal memory, and kept on a free
+ * list for reuse when ranges are removed.
  */
 
 #include <lib/allocator.h>
@@ -26,94 +42,359 @@
 #include <loader.h>
 #include <memory.h>
 
-/** Structure of a region. */
-typedef struct allocator_region {
-	list_t header;			/**< List header. */
-
-	target_ptr_t start;		/**< Start of the region. */
-	target_size_t size;		/**< Size of the region. */
-	bool allocated;			/**< Whether the region is allocated. */
-} allocator_region_t;
-
-/** Create a region structure.
- * @param start		Start of the region.
- * @param size		Size of the region.
- * @param allocated	Whether the region is allocated.
- * @return		Pointer to created region. */
-static allocator_region_t *allocator_region_create(target_ptr_t start,
-	target_size_t size, bool allocated)
+/** Number of ranges to try for an aligned allocation before giving up on the
+ * best fit. */
+#define ALLOCATOR_FIT_LIMIT	8
+
+/** Size of each block of memory to allocate range structures from. */
+#define ALLOCATOR_POOL_SIZE	0x4000
+
+/** Structure of a free range. */
+typedef struct allocator_range {
+	allocator_link_t addr_link;	/**< Link to address tree. */
+	allocator_link_t size_link;	/**< Link to size tree. */
+
+	target_ptr_t start;		/**< Start of the range. */
+	target_ptr_t end;		/**< Last address in the range. */
+} allocator_range_t;
+
+/** Get the range containing an address tree link. */
+#define addr_entry(link)	\
+	((allocator_range_t *)((char *)(link) - offsetof(allocator_range_t, addr_link)))
+
+/** Get the range containing a size tree link. */
+#define size_entry(link)	\
+	((allocator_range_t *)((char *)(link) - offsetof(allocator_range_t, size_link)))
+
+/** Get the height of a subtree.
+ * @param link		Root of the subtree (can be NULL).
+ * @return		Height of the subtree. */
+static inline int link_height(allocator_link_t *link) {
+	return (link) ? link->height : 0;
+}
+
+/** Recalculate the height of a node.
+ * @param link		Node to update. */
+static inline void link_update(allocator_link_t *link) {
+	link->height = MAX(link_height(link->left), link_height(link->right)) + 1;
+}
+
+/** Replace a child of a node.
+ * @param rootp		Pointer to root of the tree.
+ * @param parent	Parent node (NULL if replacing the root).
+ * @param old		Child to replace.
+ * @param link		New child (can be NULL). */
+static void link_replace(allocator_link_t **rootp, allocator_link_t *parent,
+	allocator_link_t *old, allocator_link_t *link)
 {
-	allocator_region_t *region = kmalloc(sizeof(*region));
-	list_init(&region->header);
-	region->start = start;
-	region->size = size;
-	region->allocated = allocated;
-	return region;
+	if(!parent) {
+		*rootp = link;
+	} else if(parent->left == old) {
+		parent->left = link;
+	} else {
+		parent->right = link;
+	}
+
+	if(link)
+		link->parent = parent;
 }
 
-/** Insert a region into the allocator.
- * @param alloc		Allocator to insert into.
- * @param region	Region to insert. */
-static void insert_region(allocator_t *alloc, allocator_region_t *region) {
-	allocator_region_t *other, *split;
-	phys_ptr_t region_end, other_end;
-
-	/* We need to deal with the case where start + size wraps to 0, i.e. if
-	 * we are allocating from the whole address space. */
-	region_end = region->start + region->size - 1;
-
-	/* Try to find where to insert the region in the list. */
-	LIST_FOREACH(&alloc->regions, iter) {
-		other = list_entry(iter, allocator_region_t, header);
-		if(region->start <= other->start) {
-			list_add_before(&other->header, &region->header);
-			break;
+/** Rotate a subtree left.
+ * @param rootp		Pointer to root of the tree.
+ * @param link		Root of the subtree.
+ * @return		New root of the subtree. */
+static allocator_link_t *link_rotate_left(allocator_link_t **rootp, allocator_link_t *link) {
+	allocator_link_t *child = link->right;
+
+	link->right = child->left;
+	if(link->right)
+		link->right->parent = link;
+
+	link_replace(rootp, link->parent, link, child);
+	child->left = link;
+	link->parent = child;
+
+	link_update(link);
+	link_update(child);
+	return child;
+}
+
+/** Rotate a subtree right.
+ * @param rootp		Pointer to root of the tree.
+ * @param link		Root of the subtree.
+ * @return		New root of the subtree. */
+static allocator_link_t *link_rotate_right(allocator_link_t **rootp, allocator_link_t *link) {
+	allocator_link_t *child = link->left;
+
+	link->left = child->right;
+	if(link->left)
+		link->left->parent = link;
+
+	link_replace(rootp, link->parent, link, child);
+	child->right = link;
+	link->parent = child;
+
+	link_update(link);
+	link_update(child);
+	return child;
+}
+
+/** Rebalance a tree after a modification.
+ * @param rootp		Pointer to root of the tree.
+ * @param link		Lowest node whose subtree was changed. */
+static void link_rebalance(allocator_link_t **rootp, allocator_link_t *link) {
+	int balance;
+
+	while(link) {
+		link_update(link);
+		balance = link_height(link->left) - link_height(link->right);
+
+		if(balance > 1) {
+			if(link_height(link->left->left) < link_height(link->left->right))
+				link_rotate_left(rootp, link->left);
+
+			link = link_rotate_right(rootp, link);
+		} else if(balance < -1) {
+			if(link_height(link->right->right) < link_height(link->right->left))
+				link_rotate_right(rootp, link->right);
+
+			link = link_rotate_left(rootp, link);
+		}
+
+		link = link->parent;
+	}
+}
+
+/** Insert a node into a tree.
+ * @param rootp		Pointer to root of the tree.
+ * @param link		Node to insert.
+ * @param compare	Function returning whether the first node should be
+ *			placed before the second. */
+static void link_insert(allocator_link_t **rootp, allocator_link_t *link,
+	bool (*compare)(allocator_link_t *, allocator_link_t *))
+{
+	allocator_link_t **pos = rootp, *parent = NULL;
+
+	while(*pos) {
+		parent = *pos;
+		pos = (compare(link, parent)) ? &parent->left : &parent->right;
+	}
+
+	link->parent = parent;
+	link->left = link->right = NULL;
+	link->height = 1;
+	*pos = link;
+
+	link_rebalance(rootp, parent);
+}
+
+/** Remove a node from a tree.
+ * @param rootp		Pointer to root of the tree.
+ * @param link		Node to remove. */
+static void link_remove(allocator_link_t **rootp, allocator_link_t *link) {
+	allocator_link_t *next, *fixup;
+
+	if(!link->left || !link->right) {
+		fixup = link->parent;
+		link_replace(rootp, link->parent, link, (link->left) ? link->left : link->right);
+	} else {
+		/* Move the in-order successor into the position of the node. */
+		next = link->right;
+		while(next->left)
+			next = next->left;
+
+		if(next->parent != link) {
+			fixup = next->parent;
+			link_replace(rootp, next->parent, next, next->right);
+			next->right = link->right;
+			next->right->parent = next;
+		} else {
+			fixup = next;
 		}
+
+		next->left = link->left;
+		next->left->parent = next;
+		next->height = link->height;
+		link_replace(rootp, link->parent, link, next);
+	}
+
+	link_rebalance(rootp, fixup);
+}
+
+/** Get the in-order successor of a node.
+ * @param link		Node to get successor of.
+ * @return		Successor node, or NULL if none. */
+static allocator_link_t *link_next(allocator_link_t *link) {
+	if(link->right) {
+		link = link->right;
+		while(link->left)
+			link = link->left;
+
+		return link;
+	}
+
+	while(link->parent && link->parent->right == link)
+		link = link->parent;
+
+	return link->parent;
+}
+
+/** Address tree ordering function. */
+static bool addr_compare(allocator_link_t *a, allocator_link_t *b) {
+	return addr_entry(a)->start < addr_entry(b)->start;
+}
+
+/** Size tree ordering function. */
+static bool size_compare(allocator_link_t *a, allocator_link_t *b) {
+	allocator_range_t *ra = size_entry(a), *rb = size_entry(b);
+
+	if(ra->end - ra->start != rb->end - rb->start)
+		return (ra->end - ra->start) < (rb->end - rb->start);
+
+	return ra->start < rb->start;
+}
+
+/** Return a range structure to the free list.
+ * @param alloc		Allocator the range belongs to.
+ * @param range		Range to free. Unused ranges are linked through the
+ *			parent pointer of their address tree link. */
+static void range_free(allocator_t *alloc, allocator_range_t *range) {
+	range->addr_link.parent = (allocator_link_t *)alloc->unused;
+	alloc->unused = range;
+}
+
+/** Allocate a range structure.
+ * @param alloc		Allocator to allocate for.
+ * @return		Pointer to range structure. */
+static allocator_range_t *range_new(allocator_t *alloc) {
+	allocator_range_t *range;
+	phys_ptr_t phys;
+	size_t i;
+
+	/* The memory is internal, so it is reclaimed with everything else
+	 * when the OS is entered. */
+	if(!alloc->unused) {
+		phys_memory_alloc(ALLOCATOR_POOL_SIZE, 0, 0, 0, PHYS_MEMORY_INTERNAL, 0, &phys);
+
+		range = (allocator_range_t *)P2V(phys);
+		for(i = 0; i < ALLOCATOR_POOL_SIZE / sizeof(*range); i++)
+			range_free(alloc, &range[i]);
+	}
+
+	range = alloc->unused;
+	alloc->unused = (allocator_range_t *)range->addr_link.parent;
+	return range;
+}
+
+/** Create a free range.
+ * @param alloc		Allocator to add to.
+ * @param start		Start of the range.
+ * @param end		Last address in the range. */
+static void range_create(allocator_t *alloc, target_ptr_t start, target_ptr_t end) {
+	allocator_range_t *range = range_new(alloc);
+
+	range->start = start;
+	range->end = end;
+	link_insert(&alloc->addr_tree, &range->addr_link, addr_compare);
+	link_insert(&alloc->size_tree, &range->size_link, size_compare);
+	alloc->count++;
+}
+
+/** Remove part of a free range.
+ * @param alloc		Allocator the range belongs to.
+ * @param range		Range to remove from.
+ * @param start		Start of the part to remove.
+ * @param end		Last address of the part to remove. */
+static void range_remove(allocator_t *alloc, allocator_range_t *range, target_ptr_t start,
+	target_ptr_t end)
+{
+	target_ptr_t range_end = range->end;
+
+	assert(start >= range->start && end <= range->end);
+
+	/* Trimming the range does not change its position in the address
+	 * tree, but it does in the size tree. */
+	link_remove(&alloc->size_tree, &range->size_link);
+
+	if(start > range->start) {
+		range->end = start - 1;
+		link_insert(&alloc->size_tree, &range->size_link, size_compare);
+
+		if(end < range_end)
+			range_create(alloc, end + 1, range_end);
+	} else if(end < range_end) {
+		range->start = end + 1;
+		link_insert(&alloc->size_tree, &range->size_link, size_compare);
+	} else {
+		link_remove(&alloc->addr_tree, &range->addr_link);
+		alloc->count--;
+		range_free(alloc, range);
 	}
+}
 
-	/* If the region has not been added, add it now. */
-	if(list_empty(&region->header))
-		list_append(&alloc->regions, &region->header);
-
-	/* Check if the new region has overlapped part of the previous. */
-	if(list_first(&alloc->regions, allocator_region_t, header) != region) {
-		other = list_prev(&region->header, allocator_region_t, header);
-		other_end = other->start + other->size - 1;
-
-		if(region->start <= other_end) {
-			if(other_end > region_end) {
-				/* Must split the region. */
-				split = allocator_region_create(region_end + 1,
-					other_end - region_end,
-					other->allocated);
-				list_add_after(&region->header, &split->header);
-			}
-
-			other->size = region->start - other->start;
+/** Find the first free range ending at or after an address.
+ * @param alloc		Allocator to search.
+ * @param addr		Address to search for.
+ * @return		Range found, or NULL if none. */
+static allocator_range_t *range_lookup(allocator_t *alloc, target_ptr_t addr) {
+	allocator_link_t *link = alloc->addr_tree;
+	allocator_range_t *range, *ret = NULL;
+
+	while(link) {
+		range = addr_entry(link);
+		if(addr < range->start) {
+			ret = range;
+			link = link->left;
+		} else if(addr > range->end) {
+			link = link->right;
+		} else {
+			return range;
 		}
 	}
 
-	/* Swallow up any following ranges that the new range overlaps. */
-	LIST_FOREACH_SAFE(&region->header, iter) {
-		if(iter == &alloc->regions)
-			break;
-
-		other = list_entry(iter, allocator_region_t, header);
-		other_end = other->start + other->size - 1;
-
-		if(other->start > region_end) {
-			break;
-		} else if(other_end > region_end) {
-			/* Resize the range and finish. */
-			other->start = region_end + 1;
-			other->size = other_end - region_end;
-			break;
+	return ret;
+}
+
+/** Find the smallest free range larger than a size.
+ * @param alloc		Allocator to search.
+ * @param size		Minimum size of the range, minus 1.
+ * @return		Size tree link of range found, or NULL if none. */
+static allocator_link_t *size_lookup(allocator_t *alloc, target_size_t size) {
+	allocator_link_t *link = alloc->size_tree, *ret = NULL;
+	allocator_range_t *range;
+
+	while(link) {
+		range = size_entry(link);
+		if(range->end - range->start >= size) {
+			ret = link;
+			link = link->left;
 		} else {
-			/* Completely remove the range. */
-			list_remove(&other->header);
-			kfree(other);
+			link = link->right;
 		}
 	}
+
+	return ret;
+}
+
+/** Try to allocate from a free range.
+ * @param alloc		Allocator the range belongs to.
+ * @param range		Range to allocate from.
+ * @param size		Size of the region to allocate.
+ * @param align		Alignment of the region.
+ * @param addrp		Where to store address of allocated region.
+ * @return		Whether the region fits in the range. */
+static bool range_alloc(allocator_t *alloc, allocator_range_t *range, target_size_t size,
+	target_size_t align, target_ptr_t *addrp)
+{
+	target_ptr_t start;
+
+	start = ROUND_UP(range->start, align);
+	if(start < range->start || start + size - 1 < start || start + size - 1 > range->end)
+		return false;
+
+	range_remove(alloc, range, start, start + size - 1);
+	*addrp = start;
+	return true;
 }
 
 /** Allocate a region from an allocator.
@@ -125,8 +406,8 @@ static void insert_region(allocator_t *alloc, allocator_region_t *region) {
 bool allocator_alloc(allocator_t *alloc, target_size_t size, target_size_t align,
 	target_ptr_t *addrp)
 {
-	allocator_region_t *region;
-	target_ptr_t start;
+	allocator_link_t *link, *fit;
+	size_t i;
 
 	assert(!(size % PAGE_SIZE));
 	assert(!(align % PAGE_SIZE));
@@ -135,21 +416,31 @@ bool allocator_alloc(allocator_t *alloc, target_size_t size, target_size_t align
 	if(!align)
 		align = PAGE_SIZE;
 
-	LIST_FOREACH(&alloc->regions, iter) {
-		region = list_entry(iter, allocator_region_t, header);
-		if(region->allocated)
-			continue;
+	/* Find the smallest range that is large enough. With page alignment
+	 * this always fits, otherwise alignment may prevent the allocation
+	 * from fitting, so try the next few larger ranges as well. */
+	link = size_lookup(alloc, size - 1);
+	for(i = 0; link && i < ALLOCATOR_FIT_LIMIT; i++, link = link_next(link)) {
+		if(range_alloc(alloc, size_entry(link), size, align, addrp))
+			return true;
+	}
 
-		start = ROUND_UP(region->start, align);
-		if(start + size - 1 > region->start + region->size - 1)
-			continue;
+	if(!link)
+		return false;
 
-		*addrp = start;
+	/* Any range of at least (size + align - PAGE_SIZE) is guaranteed to
+	 * fit, so look for the smallest of those rather than walking over
+	 * what could be a large number of ranges that do not fit. */
+	if(size + align - PAGE_SIZE > size) {
+		fit = size_lookup(alloc, size + align - PAGE_SIZE - 1);
+		if(fit)
+			return range_alloc(alloc, size_entry(fit), size, align, addrp);
+	}
 
-		/* Create a new allocated region and insert over this space. */
-		region = allocator_region_create(start, size, true);
-		insert_region(alloc, region);
-		return true;
+	/* Nothing is guaranteed to fit, check the remaining ranges. */
+	for(; link; link = link_next(link)) {
+		if(range_alloc(alloc, size_entry(link), size, align, addrp))
+			return true;
 	}
 
 	return false;
@@ -168,27 +459,28 @@ bool allocator_alloc(allocator_t *alloc, target_size_t size, target_size_t align
  * @return		Whether successfully inserted.
  */
 bool allocator_insert(allocator_t *alloc, target_ptr_t addr, target_size_t size) {
-	target_ptr_t region_end, other_end;
-	allocator_region_t *other;
+	target_ptr_t region_end, alloc_end, start, end;
+	allocator_range_t *range;
 
 	assert(!(addr % PAGE_SIZE));
 	assert(!(size % PAGE_SIZE));
 	assert(size);
 
+	/* Only the part of the region within the allocator can conflict. */
 	region_end = addr + size - 1;
+	alloc_end = alloc->start + alloc->size - 1;
+	start = MAX(addr, alloc->start);
+	end = MIN(region_end, alloc_end);
+	if(end < start)
+		return true;
 
-	/* Check for conflicts with other allocated regions. */
-	LIST_FOREACH(&alloc->regions, iter) {
-		other = list_entry(iter, allocator_region_t, header);
-		if(!other->allocated)
-			continue;
-
-		other_end = other->start + other->size - 1;
-		if(MAX(addr, other->start) <= MIN(region_end, other_end))
-			return false;
-	}
+	/* Free ranges are never adjacent, so the region is only free if it is
+	 * entirely contained in a single range. */
+	range = range_lookup(alloc, start);
+	if(!range || range->start > start || range->end < end)
+		return false;
 
-	allocator_reserve(alloc, addr, size);
+	range_remove(alloc, range, start, end);
 	return true;
 }
 
@@ -204,7 +496,8 @@ bool allocator_insert(allocator_t *alloc, target_ptr_t addr, target_size_t size)
  */
 void allocator_reserve(allocator_t *alloc, target_ptr_t addr, target_size_t size) {
 	target_ptr_t region_end, alloc_end, end;
-	allocator_region_t *region;
+	allocator_range_t *range, *next;
+	allocator_link_t *link;
 
 	assert(!(addr % PAGE_SIZE));
 	assert(!(size % PAGE_SIZE));
@@ -217,10 +510,16 @@ void allocator_reserve(allocator_t *alloc, target_ptr_t addr, target_size_t size
 	end = MIN(region_end, alloc_end);
 	if(end < addr)
 		return;
-	size = MIN(region_end, alloc_end) - addr + 1;
 
-	region = allocator_region_create(addr, size, true);
-	insert_region(alloc, region);
+	/* Remove the region from every free range that it overlaps. */
+	range = range_lookup(alloc, addr);
+	while(range && range->start <= end) {
+		link = link_next(&range->addr_link);
+		next = (link) ? addr_entry(link) : NULL;
+
+		range_remove(alloc, range, MAX(addr, range->start), MIN(end, range->end));
+		range = next;
+	}
 }
 
 /** Initialize an allocator.
@@ -230,17 +529,17 @@ void allocator_reserve(allocator_t *alloc, target_ptr_t addr, target_size_t size
  *			can be used in conjunction with 0 start to mean the
  *			entire address space. */
 void allocator_init(allocator_t *alloc, target_ptr_t start, target_size_t size) {
-	allocator_region_t *region;
-
 	assert(!(start % PAGE_SIZE));
 	assert(!(size % PAGE_SIZE));
 	assert((start + size) > start || (start + size) == 0);
 
-	list_init(&alloc->regions);
 	alloc->start = start;
 	alloc->size = size;
+	alloc->addr_tree = NULL;
+	alloc->size_tree = NULL;
+	alloc->count = 0;
+	alloc->unused = NULL;
 
-	/* Add a free region covering the entire space. */
-	region = allocator_region_create(start, size, false);
-	list_append(&alloc->regions, &region->header);
+	/* Add a free range covering the entire space. */
+	range_create(alloc, start, start + size - 1);
 }
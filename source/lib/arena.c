@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Arena allocator.
+ *
+ * An arena provides fast allocation of short-lived memory. Allocations are
+ * made by bumping a pointer within a block obtained from the heap, and cannot
+ * be freed individually. Instead, the current position of the arena can be
+ * saved with arena_mark(), and everything allocated since then can be freed
+ * at once with arena_release(). Marks must be released in the reverse order
+ * to which they were taken.
+ *
+ * The global scratch arena is intended for temporary buffers which only need
+ * to live for the duration of a single function, for example path strings or
+ * filesystem blocks. Memory from the scratch arena must not be held on to
+ * after the function that allocated it returns.
+ */
+
+#include <lib/arena.h>
+#include <lib/string.h>
+#include <lib/utility.h>
+
+#include <memory.h>
+
+/** Structure of a block in an arena. */
+typedef struct arena_block {
+	struct arena_block *prev;	/**< Previous block. */
+	size_t size;			/**< Total size of the block. */
+} __aligned(8) arena_block_t;
+
+/** Default size of an arena block. */
+#define ARENA_BLOCK_SIZE	8192
+
+/** Global scratch arena. */
+arena_t scratch_arena = ARENA_INITIALIZER;
+
+/** Allocate memory from an arena.
+ * @note		An internal error will be raised if the heap is full.
+ * @param arena		Arena to allocate from.
+ * @param size		Size of allocation to make.
+ * @return		Address of allocation. */
+void *arena_alloc(arena_t *arena, size_t size) {
+	arena_block_t *block;
+	void *ret;
+
+	/* Align all allocations to 8 bytes, as kmalloc() does. */
+	size = ROUND_UP(size, 8);
+
+	if(!arena->current || arena->offset + size > arena->current->size) {
+		if(arena->spare && sizeof(arena_block_t) + size <= arena->spare->size) {
+			block = arena->spare;
+			arena->spare = NULL;
+		} else {
+			block = kmalloc(MAX(ARENA_BLOCK_SIZE, sizeof(arena_block_t) + size));
+			block->size = MAX(ARENA_BLOCK_SIZE, sizeof(arena_block_t) + size);
+		}
+
+		block->prev = arena->current;
+		arena->current = block;
+		arena->offset = sizeof(arena_block_t);
+	}
+
+	ret = (char *)arena->current + arena->offset;
+	arena->offset += size;
+	return ret;
+}
+
+/** Duplicate a string using an arena.
+ * @param arena		Arena to allocate from.
+ * @param str		String to duplicate.
+ * @return		Pointer to duplicated string. */
+char *arena_strdup(arena_t *arena, const char *str) {
+	size_t len = strlen(str) + 1;
+	char *dup;
+
+	dup = arena_alloc(arena, len);
+	memcpy(dup, str, len);
+	return dup;
+}
+
+/** Free everything allocated from an arena since a position was saved.
+ * @param arena		Arena to release.
+ * @param mark		Position saved with arena_mark(). */
+void arena_release(arena_t *arena, arena_mark_t mark) {
+	arena_block_t *block;
+
+	while(arena->current != mark.block) {
+		block = arena->current;
+		arena->current = block->prev;
+
+		/* Keep a standard sized block around so that repeatedly
+		 * marking and releasing does not go back to the heap. */
+		if(!arena->spare && block->size == ARENA_BLOCK_SIZE) {
+			arena->spare = block;
+		} else {
+			kfree(block);
+		}
+	}
+
+	arena->offset = mark.offset;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief		LZ4 block decompression.
+ *
+ * This decodes the LZ4 block format, i.e. the raw compressed data without
+ * the LZ4 frame header. Input is treated as untrusted: every length and
+ * offset is checked against the bounds of the source and destination
+ * buffers, so corrupt data results in an error rather than an overrun.
+ */
+
+#include <lib/lz4.h>
+#include <lib/string.h>
+
+/** Minimum length of a match. */
+#define LZ4_MIN_MATCH		4
+
+/** Read an LZ4 length extension.
+ * @param ipp		Pointer to input pointer, updated.
+ * @param iend		End of the input.
+ * @param lenp		Length to add to.
+ * @return		Whether the input was long enough. */
+static bool read_length(const uint8_t **ipp, const uint8_t *iend, size_t *lenp) {
+	const uint8_t *ip = *ipp;
+	uint8_t byte;
+
+	do {
+		if(ip >= iend)
+			return false;
+
+		byte = *ip++;
+		*lenp += byte;
+	} while(byte == 255);
+
+	*ipp = ip;
+	return true;
+}
+
+/** Decompress an LZ4 block.
+ * @param src		Compressed data.
+ * @param src_size	Size of the compressed data.
+ * @param dest		Buffer to decompress to.
+ * @param dest_size	Size of the destination buffer.
+ * @param sizep		Where to store the decompressed size.
+ * @return		Whether the data was valid and fit in the buffer. */
+bool lz4_decompress(const void *src, size_t src_size, void *dest, size_t dest_size,
+	size_t *sizep)
+{
+	const uint8_t *ip = src, *iend = ip + src_size;
+	uint8_t *op = dest, *oend = op + dest_size;
+	size_t len, offset;
+	uint8_t token;
+
+	while(ip < iend) {
+		token = *ip++;
+
+		/* Copy literals. */
+		len = token >> 4;
+		if(len == 15 && !read_length(&ip, iend, &len))
+			return false;
+		if(len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+			return false;
+
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* The last sequence has literals only. */
+		if(ip == iend)
+			break;
+
+		/* Copy the match. */
+		if(iend - ip < 2)
+			return false;
+
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (size_t)(op - (uint8_t *)dest))
+			return false;
+
+		len = token & 15;
+		if(len == 15 && !read_length(&ip, iend, &len))
+			return false;
+		len += LZ4_MIN_MATCH;
+		if(len > (size_t)(oend - op))
+			return false;
+
+		if(offset >= len) {
+			memcpy(op, op - offset, len);
+			op += len;
+		} else {
+			/* Overlapping match, repeats the last offset bytes. */
+			for(; len != 0; len--, op++)
+				*op = *(op - offset);
+		}
+	}
+
+	*sizep = op - (uint8_t *)dest;
+	return true;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief		SHA-256 hash function.
+ *
+ * This is a straightforward implementation of SHA-256 as described in FIPS
+ * 180-4. It is structured so that data can be hashed incrementally as it is
+ * read in, rather than requiring a separate pass over the data once it is in
+ * memory. If the architecture provides an accelerated block transform, that
+ * is used for all whole blocks, with this implementation as a fallback for
+ * when the CPU does not support it.
+ */
+
+#include <lib/sha256.h>
+#include <lib/string.h>
+#include <lib/utility.h>
+
+/** SHA-256 round constants. */
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Rotate a 32-bit value right. */
+#define ROR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+/** Load a big-endian 32-bit value.
+ * @param p		Pointer to value.
+ * @return		Value in native byte order. */
+static inline uint32_t load_be32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+		| ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/** Store a big-endian 32-bit value.
+ * @param p		Pointer to store at.
+ * @param val		Value to store. */
+static inline void store_be32(uint8_t *p, uint32_t val) {
+	p[0] = val >> 24;
+	p[1] = val >> 16;
+	p[2] = val >> 8;
+	p[3] = val;
+}
+
+/** Hash blocks of data using the generic implementation.
+ * @param state		Hash state to update.
+ * @param data		Data to hash.
+ * @param blocks	Number of whole blocks to hash. */
+static void sha256_transform_generic(uint32_t *state, const uint8_t *data, size_t blocks) {
+	uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+	size_t i;
+
+	while(blocks--) {
+		for(i = 0; i < 16; i++)
+			w[i] = load_be32(&data[i * 4]);
+
+		for(i = 16; i < 64; i++) {
+			t1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			t2 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			w[i] = t1 + w[i - 7] + t2 + w[i - 16];
+		}
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+		for(i = 0; i < 64; i++) {
+			t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25))
+				+ ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+			t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22))
+				+ ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+		data += SHA256_BLOCK_SIZE;
+	}
+}
+
+/** Hash blocks of data.
+ * @param state		Hash state to update.
+ * @param data		Data to hash.
+ * @param blocks	Number of whole blocks to hash. */
+static inline void sha256_transform(uint32_t *state, const uint8_t *data, size_t blocks) {
+	#if CONFIG_KBOOT_HAVE_ARCH_SHA256
+	if(arch_sha256_transform(state, data, blocks))
+		return;
+	#endif
+
+	sha256_transform_generic(state, data, blocks);
+}
+
+/** Initialize a SHA-256 context.
+ * @param ctx		Context to initialize. */
+void sha256_init(sha256_context_t *ctx) {
+	ctx->state[0] = 0x6a09e667;
+	ctx->state[1] = 0xbb67ae85;
+	ctx->state[2] = 0x3c6ef372;
+	ctx->state[3] = 0xa54ff53a;
+	ctx->state[4] = 0x510e527f;
+	ctx->state[5] = 0x9b05688c;
+	ctx->state[6] = 0x1f83d9ab;
+	ctx->state[7] = 0x5be0cd19;
+	ctx->length = 0;
+	ctx->buf_len = 0;
+}
+
+/** Add data to a SHA-256 hash.
+ * @param ctx		Context to update.
+ * @param data		Data to hash.
+ * @param size		Size of the data. */
+void sha256_update(sha256_context_t *ctx, const void *data, size_t size) {
+	const uint8_t *ptr = data;
+	size_t count;
+
+	ctx->length += size;
+
+	/* Complete any partial block left over from a previous call. */
+	if(ctx->buf_len) {
+		count = MIN(size, SHA256_BLOCK_SIZE - ctx->buf_len);
+		memcpy(ctx->buf + ctx->buf_len, ptr, count);
+		ctx->buf_len += count;
+		ptr += count;
+		size -= count;
+
+		if(ctx->buf_len < SHA256_BLOCK_SIZE)
+			return;
+
+		sha256_transform(ctx->state, ctx->buf, 1);
+		ctx->buf_len = 0;
+	}
+
+	/* Hash whole blocks directly from the source buffer. */
+	count = size / SHA256_BLOCK_SIZE;
+	if(count) {
+		sha256_transform(ctx->state, ptr, count);
+		ptr += count * SHA256_BLOCK_SIZE;
+		size -= count * SHA256_BLOCK_SIZE;
+	}
+
+	if(size) {
+		memcpy(ctx->buf, ptr, size);
+		ctx->buf_len = size;
+	}
+}
+
+/** Finish a SHA-256 hash.
+ * @param ctx		Context to finish.
+ * @param digest	Where to store the digest (SHA256_DIGEST_SIZE bytes). */
+void sha256_final(sha256_context_t *ctx, uint8_t *digest) {
+	uint64_t bits = ctx->length * 8;
+	size_t i;
+
+	/* Append the terminating bit, then pad up to the length field, which
+	 * may require an extra block. */
+	ctx->buf[ctx->buf_len++] = 0x80;
+	if(ctx->buf_len > SHA256_BLOCK_SIZE - 8) {
+		memset(ctx->buf + ctx->buf_len, 0, SHA256_BLOCK_SIZE - ctx->buf_len);
+		sha256_transform(ctx->state, ctx->buf, 1);
+		ctx->buf_len = 0;
+	}
+
+	memset(ctx->buf + ctx->buf_len, 0, SHA256_BLOCK_SIZE - 8 - ctx->buf_len);
+	store_be32(&ctx->buf[56], bits >> 32);
+	store_be32(&ctx->buf[60], bits);
+	sha256_transform(ctx->state, ctx->buf, 1);
+
+	for(i = 0; i < 8; i++)
+		store_be32(&digest[i * 4], ctx->state[i]);
+}
@@ -42,7 +42,7 @@
  * @return		Destination location.
  */
 void *memcpy(void *__restrict dest, const void *__restrict src, size_t count) {
-#ifdef __i386__
+#if defined(__i386__) || defined(__x86_64__)
 	register unsigned long out;
 
 	asm volatile("rep movsb"
@@ -67,7 +67,7 @@ void *memcpy(void *__restrict dest, const void *__restrict src, size_t count) {
  * @param count		The number of bytes to fill.
  * @return		Destination location. */
 void *memset(void *dest, int val, size_t count) {
-#ifdef __i386__
+#if defined(__i386__) || defined(__x86_64__)
 	register unsigned long out;
 
 	asm volatile("rep stosb"
@@ -26,6 +26,10 @@
  *  - kboot <kernel path>
  *    Loads the specified kernel and no modules.
  *
+ * Expected digests for the kernel and modules can be given through the sha256
+ * environment variable (see verify.c). Digests for modules can also be given
+ * in the kernel image with KBOOT_ITAG_SHA256 tags.
+ *
  * @todo		Add a root_device configuration variable to specify
  *			a different device to pass as boot device to kernel,
  *			which would allow a separate boot partition and root
@@ -43,7 +47,9 @@
 #include <loader.h>
 #include <memory.h>
 #include <net.h>
+#include <trace.h>
 #include <ui.h>
+#include <verify.h>
 
 /** Structure describing a virtual memory mapping. */
 typedef struct virt_mapping {
@@ -75,27 +81,101 @@ static inline void *add_image_tag(kboot_loader_t *loader, uint32_t type, size_t
 	return &tag[1];
 }
 
+/** Ensure that the tag list has space for a certain amount of tag data.
+ * @param loader	KBoot loader data structure.
+ * @param size		Total size required. */
+static void reserve_tags(kboot_loader_t *loader, size_t size) {
+	kboot_tag_core_t *core = (kboot_tag_core_t *)P2V(loader->tags_phys);
+	size_t capacity;
+	phys_ptr_t phys;
+
+	if(size <= loader->tags_capacity)
+		return;
+
+	/* The tag list cannot be moved once it has been mapped. */
+	if(loader->tags_virt)
+		internal_error("Exceeded maximum tag list size");
+
+	/* Move the tag list to a new physically contiguous region. The old
+	 * region is left marked as reclaimable. Nothing holds pointers into
+	 * the tag list across allocations of further tags, so this is safe. */
+	capacity = MAX(loader->tags_capacity * 2, ROUND_UP(size, PAGE_SIZE));
+	phys_memory_alloc(capacity, 0, 0, 0, PHYS_MEMORY_RECLAIMABLE, 0, &phys);
+	memcpy((void *)P2V(phys), core, core->tags_size);
+
+	dprintf("kboot: moved tag list to 0x%" PRIxPHYS " (capacity: %zu)\n", phys, capacity);
+
+	loader->tags_phys = phys;
+	loader->tags_capacity = capacity;
+	core = (kboot_tag_core_t *)P2V(phys);
+	core->tags_phys = phys;
+}
+
 /** Allocate a tag list entry.
  * @param loader	KBoot loader data structure.
  * @param type		Type of the tag.
  * @param size		Size of the tag data.
- * @return		Pointer to allocated tag. Will be cleared to 0. */
+ * @return		Pointer to allocated tag. Will be cleared to 0. Only
+ *			valid until the next tag is allocated, as the tag list
+ *			may be moved to make space. */
 void *kboot_allocate_tag(kboot_loader_t *loader, uint32_t type, size_t size) {
 	kboot_tag_core_t *core = (kboot_tag_core_t *)P2V(loader->tags_phys);
 	kboot_tag_t *ret;
 
+	reserve_tags(loader, core->tags_size + ROUND_UP(size, 8));
+	core = (kboot_tag_core_t *)P2V(loader->tags_phys);
+
 	ret = (kboot_tag_t *)P2V(loader->tags_phys + core->tags_size);
 	memset(ret, 0, size);
 	ret->type = type;
 	ret->size = size;
 
 	core->tags_size += ROUND_UP(size, 8);
-	if(core->tags_size > PAGE_SIZE)
-		internal_error("Exceeded maximum tag list size");
-
 	return ret;
 }
 
+/** Map the tag list into the kernel's address space.
+ * @param loader	KBoot loader data structure. */
+static void map_tag_list(kboot_loader_t *loader) {
+	kboot_tag_core_t *core;
+	size_t mappings, ranges, tables, capacity, size;
+
+	/* After this point, only the virtual and physical memory maps are
+	 * added, so the remaining space needed can be worked out. Allow for
+	 * the tag list mapping itself, and for the memory map being split up
+	 * by a move of the tag list. Mapping the tag list can also allocate
+	 * page tables, each of which can split a free range in two. At most
+	 * one last level table per page is needed, plus two at each of the
+	 * (at most two) levels above that which may not exist yet. Moving the
+	 * tag list increases the size of the mapping, so repeat until the
+	 * capacity is enough. */
+	do {
+		mappings = 0;
+		LIST_FOREACH(&loader->mappings, iter)
+			mappings++;
+		ranges = 0;
+		LIST_FOREACH(&memory_ranges, iter)
+			ranges++;
+
+		capacity = loader->tags_capacity;
+		tables = (capacity / PAGE_SIZE) + 4;
+
+		core = (kboot_tag_core_t *)P2V(loader->tags_phys);
+		size = core->tags_size;
+		size += (mappings + 1) * ROUND_UP(sizeof(kboot_tag_vmem_t), 8);
+		size += (ranges + 2 + (tables * 2)) * ROUND_UP(sizeof(kboot_tag_memory_t), 8);
+		size += ROUND_UP(sizeof(kboot_tag_memstats_t), 8);
+		#if CONFIG_KBOOT_HAVE_TRACE
+		size += ROUND_UP(sizeof(kboot_tag_timing_t) + (TRACE_PHASE_COUNT * sizeof(uint64_t)), 8);
+		#endif
+		size += ROUND_UP(sizeof(kboot_tag_t), 8);
+		reserve_tags(loader, size);
+	} while(loader->tags_capacity != capacity);
+
+	loader->tags_virt = kboot_allocate_virtual(loader, loader->tags_phys,
+		loader->tags_capacity);
+}
+
 /** Insert a virtual address mapping.
  * @param loader	KBoot loader data structure.
  * @param start		Virtual address of start of mapping.
@@ -135,11 +215,24 @@ static void add_virt_mapping(kboot_loader_t *loader, kboot_vaddr_t start,
 kboot_vaddr_t kboot_allocate_virtual(kboot_loader_t *loader, kboot_paddr_t phys,
 	kboot_vaddr_t size)
 {
-	kboot_vaddr_t addr;
+	kboot_vaddr_t addr, align = 0, offset = 0;
+
+	/* If the range is big enough to benefit, give it the same offset into
+	 * a large page as the physical address so that it can be mapped with
+	 * large pages. The allocator only aligns, so allocate extra space in
+	 * front of the range to get the offset. */
+	if(phys != ~(kboot_paddr_t)0 && loader->large_page_size
+		&& size >= loader->large_page_size)
+	{
+		align = loader->large_page_size;
+		offset = phys % align;
+	}
 
-	if(!allocator_alloc(&loader->alloc, size, 0, &addr))
+	if(!allocator_alloc(&loader->alloc, size + offset, align, &addr))
 		boot_error("Unable to allocate %zu bytes of virtual address space", size);
 
+	addr += offset;
+
 	if(phys != ~(kboot_paddr_t)0)
 		mmu_map(loader->mmu, addr, phys, size);
 
@@ -164,91 +257,285 @@ void kboot_map_virtual(kboot_loader_t *loader, kboot_vaddr_t addr, kboot_paddr_t
 	add_virt_mapping(loader, addr, size, phys);
 }
 
-/** Load a single module.
+/** Structure describing a module to load. */
+typedef struct kboot_module {
+	list_t header;			/**< Link to module list. */
+	file_handle_t *handle;		/**< Handle to the module (closed once loaded). */
+	char *name;			/**< Name of the module. */
+	char *path;			/**< Path to the module. */
+	offset_t location;		/**< Location of the module data on disk. */
+	phys_ptr_t addr;		/**< Address the module was loaded to. */
+	offset_t size;			/**< Size of the module. */
+} kboot_module_t;
+
+/** Add a module to the list of modules to load.
  * @param loader	KBoot loader data structure.
- * @param handle	Handle to module to load.
- * @param name		Name of the module. */
-static void load_module(kboot_loader_t *loader, file_handle_t *handle, const char *name) {
-	kboot_tag_module_t *tag;
-	phys_ptr_t addr;
-	offset_t size;
-	uint32_t name_size;
+ * @param handle	Handle to module (a reference will be taken).
+ * @param name		Name of the module.
+ * @param path		Path to the module (will be duplicated). */
+static void add_module(kboot_loader_t *loader, file_handle_t *handle, const char *name,
+	const char *path)
+{
+	kboot_module_t *module;
 
 	if(handle->directory)
 		return;
 
-	kprintf("Loading %s...\n", name);
-
-	/* Allocate a chunk of memory to load to. */
-	size = file_size(handle);
-	phys_memory_alloc(ROUND_UP(size, PAGE_SIZE), 0, 0, 0, PHYS_MEMORY_MODULES,
-		0, &addr);
-	if(!file_read(handle, (void *)P2V(addr), size, 0))
-		boot_error("Could not read module `%s'", name);
-
-	name_size = strlen(name) + 1;
-
-	/* Add the module to the tag list. */
-	tag = kboot_allocate_tag(loader, KBOOT_TAG_MODULE, ROUND_UP(sizeof(*tag), 8)
-		+ name_size);
-	tag->addr = addr;
-	tag->size = size;
-	tag->name_size = name_size;
-
-	memcpy((char *)tag + ROUND_UP(sizeof(*tag), 8), name, name_size);
-
-	dprintf("kboot: loaded module %s to 0x%" PRIxPHYS " (size: %" PRIu64 ")\n",
-		name, addr, size);
+	module = kmalloc(sizeof(*module));
+	list_init(&module->header);
+	module->handle = handle;
+	module->name = kstrdup(name);
+	module->path = kstrdup(path);
+	module->location = file_location(handle);
+	module->size = file_size(handle);
+
+	handle->count++;
+	list_append(&loader->module_list, &module->header);
+	loader->module_count++;
 }
 
-/** Load a list of modules.
+/** Add a list of modules to the list of modules to load.
  * @param loader	KBoot loader data structure.
- * @param list		List to load. */
-static void load_module_list(kboot_loader_t *loader, value_list_t *list) {
+ * @param values	List of module paths.
+ * @param canfail	Whether to return false on failure rather than raising
+ *			a boot error.
+ * @return		Whether successful. */
+static bool add_module_list(kboot_loader_t *loader, value_list_t *values, bool canfail) {
 	file_handle_t *handle;
 	char *tmp;
 	size_t i;
 
-	for(i = 0; i < list->count; i++) {
-		handle = file_open(list->values[i].string, NULL);
-		if(!handle)
-			boot_error("Could not open module %s", list->values[i].string);
+	for(i = 0; i < values->count; i++) {
+		handle = file_open(values->values[i].string, NULL);
+		if(!handle) {
+			if(canfail)
+				return false;
 
-		tmp = strrchr(list->values[i].string, '/');
-		load_module(loader, handle, (tmp) ? tmp + 1 : list->values[i].string);
+			boot_error("Could not open module %s", values->values[i].string);
+		}
+
+		tmp = strrchr(values->values[i].string, '/');
+		add_module(loader, handle, (tmp) ? tmp + 1 : values->values[i].string,
+			values->values[i].string);
 		file_close(handle);
 	}
+
+	return true;
 }
 
-/** Callback to load a module from a directory.
+/** Callback to add a module from a directory.
  * @param name		Name of the entry.
  * @param handle	Handle to entry.
  * @param _loader	KBoot loader data structure.
  * @return		Whether to continue iteration. */
-static bool load_modules_cb(const char *name, file_handle_t *handle, void *_loader) {
-	load_module(_loader, handle, name);
+static bool add_module_dir_cb(const char *name, file_handle_t *handle, void *_loader) {
+	kboot_loader_t *loader = _loader;
+	char *path;
+
+	if(handle->directory)
+		return true;
+
+	path = kmalloc(strlen(loader->modules.string) + strlen(name) + 2);
+	sprintf(path, "%s/%s", loader->modules.string, name);
+
+	/* Handles given by dir_iterate() are not set up for decompression, so
+	 * open the module by path to get a handle that can be used to load
+	 * it and its real size. */
+	handle = file_open(path, NULL);
+	if(handle) {
+		add_module(loader, handle, name, path);
+		file_close(handle);
+	} else {
+		dprintf("kboot: warning: could not open module %s\n", path);
+	}
+
+	kfree(path);
 	return true;
 }
 
-/** Load a directory of modules.
+/** Add a directory of modules to the list of modules to load.
  * @param loader	KBoot loader data structure.
- * @param path		Path to directory. */
-static void load_module_dir(kboot_loader_t *loader, const char *path) {
+ * @param path		Path to directory.
+ * @param canfail	Whether to return false on failure rather than raising
+ *			a boot error.
+ * @return		Whether successful. */
+static bool add_module_dir(kboot_loader_t *loader, const char *path, bool canfail) {
 	file_handle_t *handle;
+	const char *err = NULL;
 
 	handle = file_open(path, NULL);
 	if(!handle) {
-		boot_error("Could not find module directory `%s'", path);
+		err = "Could not find module directory `%s'";
 	} else if(!handle->directory) {
-		boot_error("Module directory `%s' not directory", path);
+		err = "Module directory `%s' not directory";
 	} else if(!handle->mount->type->iterate) {
-		boot_error("Cannot use module directory on non-listable FS");
+		err = "Cannot use module directory on non-listable FS";
+	} else if(!dir_iterate(handle, add_module_dir_cb, loader)) {
+		err = "Failed to iterate module directory";
+	}
+
+	if(handle)
+		file_close(handle);
+
+	if(err) {
+		if(canfail)
+			return false;
+
+		boot_error(err, path);
+	}
+
+	return true;
+}
+
+/** Free the list of modules to load.
+ * @param loader	KBoot loader data structure. */
+static void free_module_list(kboot_loader_t *loader) {
+	kboot_module_t *module;
+
+	LIST_FOREACH_SAFE(&loader->module_list, iter) {
+		module = list_entry(iter, kboot_module_t, header);
+
+		list_remove(&module->header);
+		if(module->handle)
+			file_close(module->handle);
+		kfree(module->name);
+		kfree(module->path);
+		kfree(module);
+	}
+
+	kfree(loader->module_order);
+	loader->module_order = NULL;
+	loader->module_count = 0;
+}
+
+/** Work out the modules to load and the order to load them in.
+ * @param loader	KBoot loader data structure.
+ * @param canfail	Whether to return false on failure rather than raising
+ *			a boot error.
+ * @return		Whether successful. */
+static bool plan_modules(kboot_loader_t *loader, bool canfail) {
+	kboot_module_t *module;
+	size_t i, j;
+	bool ret = true;
+
+	if(loader->modules.type == VALUE_TYPE_LIST) {
+		ret = add_module_list(loader, loader->modules.list, canfail);
+	} else if(loader->modules.type == VALUE_TYPE_STRING) {
+		ret = add_module_dir(loader, loader->modules.string, canfail);
+	}
+
+	if(!ret) {
+		free_module_list(loader);
+		return false;
+	}
+
+	/* Work out the order to read the modules in. Reading them in the order
+	 * that their data is stored on disk avoids seeking back and forth
+	 * across the disk, which is very slow on rotational media. Modules for
+	 * which the location is unknown sort to the end, and modules with the
+	 * same location keep the order they were specified in. */
+	loader->module_order = kmalloc(sizeof(*loader->module_order)
+		* MAX(loader->module_count, 1));
+	i = 0;
+	LIST_FOREACH(&loader->module_list, iter) {
+		module = list_entry(iter, kboot_module_t, header);
+
+		for(j = i; j > 0 && loader->module_order[j - 1]->location > module->location; j--)
+			loader->module_order[j] = loader->module_order[j - 1];
+
+		loader->module_order[j] = module;
+		i++;
+	}
+
+	return true;
+}
+
+#if CONFIG_KBOOT_VERIFY
+
+/** Find the expected digest of a module given in the kernel image.
+ * @param loader	KBoot loader data structure.
+ * @param name		Name of the module.
+ * @return		Digest string, or NULL if not given. */
+static const char *find_module_digest(kboot_loader_t *loader, const char *name) {
+	KBOOT_ITAG_ITERATE(loader, KBOOT_ITAG_SHA256, kboot_itag_sha256_t, sha256) {
+		if(strcmp((char *)sha256 + sizeof(*sha256), name) == 0)
+			return sha256->digest;
 	}
 
-	if(!dir_iterate(handle, load_modules_cb, loader))
-		boot_error("Failed to iterate module directory");
+	return NULL;
+}
+
+#endif
+
+/** Load the data for a single module.
+ * @param loader	KBoot loader data structure.
+ * @param module	Module to load. */
+static void load_module(kboot_loader_t *loader, kboot_module_t *module) {
+	kprintf("Loading %s...\n", module->name);
+
+	#if CONFIG_KBOOT_VERIFY
+	verify_begin(module->handle, module->path, find_module_digest(loader, module->name));
+	#endif
 
-	file_close(handle);
+	/* Allocate a chunk of memory to load to. If the module is at least a
+	 * large page in size, try to align it so that the kernel can map it
+	 * using large pages. */
+	if(!loader->large_page_size || module->size < loader->large_page_size
+		|| !phys_memory_alloc(ROUND_UP(module->size, PAGE_SIZE),
+			loader->large_page_size, 0, 0, PHYS_MEMORY_MODULES,
+			PHYS_ALLOC_CANFAIL, &module->addr))
+	{
+		phys_memory_alloc(ROUND_UP(module->size, PAGE_SIZE), 0, 0, 0,
+			PHYS_MEMORY_MODULES, 0, &module->addr);
+	}
+	if(!file_read(module->handle, (void *)P2V(module->addr), module->size, 0))
+		boot_error("Could not read module `%s'", module->name);
+
+	verify_end(module->handle, module->name);
+
+	file_close(module->handle);
+	module->handle = NULL;
+}
+
+/** Add a module tag for a loaded module.
+ * @param loader	KBoot loader data structure.
+ * @param module	Module to add a tag for. */
+static void add_module_tag(kboot_loader_t *loader, kboot_module_t *module) {
+	kboot_tag_module_t *tag;
+	uint32_t name_size;
+
+	name_size = strlen(module->name) + 1;
+
+	tag = kboot_allocate_tag(loader, KBOOT_TAG_MODULE, ROUND_UP(sizeof(*tag), 8)
+		+ name_size);
+	tag->addr = module->addr;
+	tag->size = module->size;
+	tag->name_size = name_size;
+
+	memcpy((char *)tag + ROUND_UP(sizeof(*tag), 8), module->name, name_size);
+
+	dprintf("kboot: loaded module %s to 0x%" PRIxPHYS " (size: %" PRIu64 ")\n",
+		module->name, module->addr, module->size);
+}
+
+/** Load all modules specified in the configuration.
+ * @param loader	KBoot loader data structure. */
+static void load_modules(kboot_loader_t *loader) {
+	size_t i;
+
+	/* The modules may have already been planned while preloading. */
+	if(!loader->module_order)
+		plan_modules(loader, false);
+
+	for(i = 0; i < loader->module_count; i++)
+		load_module(loader, loader->module_order[i]);
+
+	/* Add the tags in the order the modules were specified, as the kernel
+	 * may depend on this. */
+	LIST_FOREACH(&loader->module_list, iter)
+		add_module_tag(loader, list_entry(iter, kboot_module_t, header));
+
+	free_module_list(loader);
 }
 
 /** Set a single option.
@@ -401,6 +688,8 @@ static void add_log_tag(kboot_loader_t *loader) {
 /** Add virtual memory tags to the tag list.
  * @param loader	KBoot loader data structure. */
 static void add_vmem_tags(kboot_loader_t *loader) {
+	target_size_t large = loader->large_page_size, mapped = 0, covered = 0;
+	target_ptr_t start, end;
 	virt_mapping_t *mapping;
 	kboot_tag_vmem_t *tag;
 
@@ -416,7 +705,22 @@ static void add_vmem_tags(kboot_loader_t *loader) {
 
 		dprintf(" 0x%" PRIx64 "-0x%" PRIx64 " -> 0x%" PRIx64 "\n", tag->start,
 			tag->start + tag->size, tag->phys);
+
+		if(mapping->phys == ~(kboot_paddr_t)0)
+			continue;
+
+		/* Work out how much of the mapping can use large pages. */
+		mapped += mapping->size;
+		if(large && (mapping->start % large) == (mapping->phys % large)) {
+			start = ROUND_UP(mapping->start, large);
+			end = ROUND_DOWN(mapping->start + mapping->size, large);
+			if(end > start)
+				covered += end - start;
+		}
 	}
+
+	dprintf("kboot: %" PRIu64 "KB of %" PRIu64 "KB mapped using large pages\n",
+		(uint64_t)covered / 1024, (uint64_t)mapped / 1024);
 }
 
 /** Add physical memory tags to the tag list.
@@ -439,6 +743,48 @@ static void add_memory_tags(kboot_loader_t *loader) {
 	}
 }
 
+/** Add memory usage statistics to the tag list.
+ * @param loader	KBoot loader data structure. */
+static void add_memstats_tag(kboot_loader_t *loader) {
+	kboot_tag_memstats_t *tag;
+	memory_stats_t stats;
+
+	memory_stats(&stats);
+
+	tag = kboot_allocate_tag(loader, KBOOT_TAG_MEMSTATS, sizeof(*tag));
+	tag->heap_size = stats.heap_size;
+	tag->heap_current = stats.heap_current;
+	tag->heap_peak = stats.heap_peak;
+	tag->heap_largest = stats.heap_largest;
+	tag->heap_allocs = stats.heap_allocs;
+	tag->heap_frees = stats.heap_frees;
+	tag->phys_allocated = stats.phys_allocated;
+	tag->phys_allocs = stats.phys_allocs;
+	tag->_pad = 0;
+}
+
+#if CONFIG_KBOOT_HAVE_TRACE
+
+/** Add boot phase timestamps to the tag list.
+ * @param loader	KBoot loader data structure. */
+static void add_timing_tag(kboot_loader_t *loader) {
+	kboot_tag_timing_t *tag;
+	size_t i;
+
+	STATIC_ASSERT(TRACE_PHASE_HANDOFF == KBOOT_TIMING_HANDOFF);
+
+	tag = kboot_allocate_tag(loader, KBOOT_TAG_TIMING, sizeof(*tag)
+		+ (TRACE_PHASE_COUNT * sizeof(uint64_t)));
+	tag->frequency = trace_frequency();
+	tag->count = TRACE_PHASE_COUNT;
+	tag->_pad = 0;
+
+	for(i = 0; i < TRACE_PHASE_COUNT; i++)
+		tag->timestamps[i] = trace_timestamp(i);
+}
+
+#endif
+
 /** Load the operating system. */
 static __noreturn void kboot_loader_load(void) {
 	kboot_loader_t *loader = current_environ->data;
@@ -455,10 +801,12 @@ static __noreturn void kboot_loader_load(void) {
 		boot_error("Kernel is not a valid KBoot kernel");
 	}
 
-	/* Create the tag list. It will be mapped into virtual memory later,
-	 * as we cannot yet perform virtual allocations. For now, assume that
-	 * the tag list never exceeds a page, which is probably reasonable. */
+	/* Create the tag list. It will be mapped into virtual memory once all
+	 * other allocations have been made, and is moved to a larger region if
+	 * it outgrows the one allocated here. */
 	phys_memory_alloc(PAGE_SIZE, 0, 0, 0, PHYS_MEMORY_RECLAIMABLE, 0, &loader->tags_phys);
+	loader->tags_capacity = PAGE_SIZE;
+	loader->tags_virt = 0;
 	core = (kboot_tag_core_t *)P2V(loader->tags_phys);
 	memset(core, 0, sizeof(kboot_tag_core_t));
 	core->header.type = KBOOT_TAG_CORE;
@@ -514,6 +862,7 @@ static __noreturn void kboot_loader_load(void) {
 
 	/* Load the kernel image. */
 	kprintf("Loading kernel...\n");
+	verify_begin(loader->kernel, loader->path, NULL);
 	kboot_elf_load_kernel(loader, load);
 
 	/* Now we need to perform all mappings specified by the image tags. */
@@ -534,27 +883,30 @@ static __noreturn void kboot_loader_load(void) {
 	}
 
 	/* Do architecture-specific setup, e.g. for page tables. */
+	trace_phase(TRACE_PHASE_MMU);
 	kboot_arch_setup(loader);
 
-	/* Now we can allocate a virtual mapping for the tag list. */
-	loader->tags_virt = kboot_allocate_virtual(loader, core->tags_phys, PAGE_SIZE);
-
 	/* Pass all of the option values. */
 	KBOOT_ITAG_ITERATE(loader, KBOOT_ITAG_OPTION, kboot_itag_option_t, option) {
 		set_option(loader, (char *)option + sizeof(*option), option->type);
 	}
 
 	/* Load modules. */
-	if(loader->modules.type == VALUE_TYPE_LIST) {
-		load_module_list(loader, loader->modules.list);
-	} else if(loader->modules.type == VALUE_TYPE_STRING) {
-		load_module_dir(loader, loader->modules.string);
-	}
+	trace_phase(TRACE_PHASE_MODULES);
+	load_modules(loader);
 
 	/* Load additional sections if requested. */
 	if(loader->image->flags & KBOOT_IMAGE_SECTIONS)
 		kboot_elf_load_sections(loader);
 
+	/* Check the kernel image once everything has been read from it. */
+	verify_end(loader->kernel, "kernel");
+
+	#if CONFIG_KBOOT_PRELOAD
+	/* The kernel's preload buffer, if any, is no longer needed. */
+	file_preload_release(loader->kernel);
+	#endif
+
 	/* Add the boot device information. */
 	add_bootdev_tag(loader);
 
@@ -571,6 +923,7 @@ static __noreturn void kboot_loader_load(void) {
 
 	/* Create a stack for the kernel. */
 	phys_memory_alloc(PAGE_SIZE, 0, 0, 0, PHYS_MEMORY_STACK, 0, &phys);
+	core = (kboot_tag_core_t *)P2V(loader->tags_phys);
 	core->stack_phys = phys;
 	core->stack_base = loader->stack_virt = kboot_allocate_virtual(loader,
 		core->stack_phys, PAGE_SIZE);
@@ -605,12 +958,20 @@ static __noreturn void kboot_loader_load(void) {
 	mmu_map(loader->transition, loader->trampoline_virt, loader->trampoline_phys,
 		PAGE_SIZE);
 
-	/* All virtual memory allocations should now have been done, we can
-	 * insert the final set of sorted virtual memory tags. */
+	/* Map the tag list. This is the final virtual memory allocation, so we
+	 * can then insert the final set of sorted virtual memory tags. */
+	map_tag_list(loader);
 	add_vmem_tags(loader);
 
 	/* Add physical memory information. */
 	add_memory_tags(loader);
+	add_memstats_tag(loader);
+
+	/* Record the handoff time and pass on the boot phase timestamps. */
+	trace_phase(TRACE_PHASE_HANDOFF);
+	#if CONFIG_KBOOT_HAVE_TRACE
+	add_timing_tag(loader);
+	#endif
 
 	/* End the tag list. */
 	kboot_allocate_tag(loader, KBOOT_TAG_NONE, sizeof(kboot_tag_t));
@@ -634,12 +995,43 @@ static ui_window_t *kboot_loader_configure(void) {
 
 #endif
 
+#if CONFIG_KBOOT_PRELOAD
+
+/** Preload part of the kernel and modules.
+ * @return		Whether there is more to preload. */
+static bool kboot_loader_preload(void) {
+	kboot_loader_t *loader = current_environ->data;
+	size_t i;
+
+	if(!loader->kernel || !loader->image)
+		return false;
+
+	if(file_preload(loader->kernel))
+		return true;
+
+	/* Errors opening modules are left to be reported when booting. */
+	if(!loader->module_order && !plan_modules(loader, true))
+		return false;
+
+	for(i = 0; i < loader->module_count; i++) {
+		if(file_preload(loader->module_order[i]->handle))
+			return true;
+	}
+
+	return false;
+}
+
+#endif
+
 /** KBoot loader type. */
 static loader_type_t kboot_loader_type = {
 	.load = kboot_loader_load,
 	#if CONFIG_KBOOT_UI
 	.configure = kboot_loader_configure,
 	#endif
+	#if CONFIG_KBOOT_PRELOAD
+	.preload = kboot_loader_preload,
+	#endif
 };
 
 /** Tag iterator to add options to the environment.
@@ -684,6 +1076,9 @@ static bool add_image_tags(elf_note_t *note, void *desc, kboot_loader_t *loader)
 	case KBOOT_ITAG_MAPPING:
 		size = sizeof(kboot_itag_mapping_t);
 		break;
+	case KBOOT_ITAG_SHA256:
+		size = sizeof(kboot_itag_sha256_t);
+		break;
 	default:
 		dprintf("kboot: warning: unrecognized image tag type %" PRIu32 "\n", note->n_type);
 		return true;
@@ -788,8 +1183,15 @@ static bool config_cmd_kboot(value_list_t *args) {
 	}
 
 	loader = kmalloc(sizeof(*loader));
+	loader->path = kstrdup(args->values[0].string);
 	list_init(&loader->itags);
 	list_init(&loader->mappings);
+	loader->ehdr = NULL;
+	loader->phdrs = NULL;
+	loader->notes = NULL;
+	list_init(&loader->module_list);
+	loader->module_order = NULL;
+	loader->module_count = 0;
 
 	current_environ->loader = &kboot_loader_type;
 	current_environ->data = loader;
@@ -811,8 +1213,10 @@ static bool config_cmd_kboot(value_list_t *args) {
 	if(!loader->kernel)
 		return true;
 
-	/* Read in all image tags from the image. */
-	kboot_elf_note_iterate(loader, add_image_tags);
+	/* Read in the image headers, which are cached for use when loading
+	 * the kernel, and all image tags from the image. */
+	if(kboot_elf_read_headers(loader))
+		kboot_elf_note_iterate(loader, add_image_tags);
 
 	/* Store a pointer to the image tag as it is used frequently. If there
 	 * is no image tag, return immediately as this is not a valid KBoot
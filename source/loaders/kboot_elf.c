@@ -24,8 +24,10 @@
 #include <loaders/kboot.h>
 
 #include <elf.h>
+#include <fs.h>
 #include <memory.h>
 #include <mmu.h>
+#include <verify.h>
 
 /** Allocate memory for the kernel image.
  * @param loader	KBoot loader data structure.
@@ -36,20 +38,32 @@
 static phys_ptr_t allocate_kernel(kboot_loader_t *loader, kboot_itag_load_t *load,
 	target_ptr_t virt_base, target_ptr_t virt_end)
 {
+	target_size_t size, large;
 	kboot_tag_core_t *core;
-	target_size_t size;
 	phys_ptr_t ret;
 	size_t align;
 
 	size = ROUND_UP(virt_end - virt_base, PAGE_SIZE);
-
-	/* Try to find some space to load to. Iterate down in powers of 2 unti
-	 * we reach the minimum alignment. */
 	align = load->alignment;
-	while(!phys_memory_alloc(size, align, 0, 0, PHYS_MEMORY_ALLOCATED, PHYS_ALLOC_CANFAIL, &ret)) {
-		align >>= 1;
-		if(align < load->min_alignment || align < PAGE_SIZE)
-			boot_error("You do not have enough memory available");
+	large = loader->large_page_size;
+
+	/* If the image has a different offset into a large page than the
+	 * alignment would give it, it cannot be mapped with large pages. Try
+	 * to give the physical address the same offset as the virtual address,
+	 * as long as that still satisfies the requested alignment. */
+	if(!large || size < large || align > large || virt_base % MAX(align, PAGE_SIZE)
+		|| !phys_memory_alloc_offset(size, large, virt_base % large, 0, 0,
+			PHYS_MEMORY_ALLOCATED, PHYS_ALLOC_CANFAIL, &ret))
+	{
+		/* Try to find some space to load to. Iterate down in powers of
+		 * 2 until we reach the minimum alignment. */
+		while(!phys_memory_alloc(size, align, 0, 0, PHYS_MEMORY_ALLOCATED,
+			PHYS_ALLOC_CANFAIL, &ret))
+		{
+			align >>= 1;
+			if(align < load->min_alignment || align < PAGE_SIZE)
+				boot_error("You do not have enough memory available");
+		}
 	}
 
 	dprintf("kboot: loading kernel to 0x%" PRIxPHYS " (alignment: 0x%" PRIxPHYS
@@ -79,8 +93,17 @@ static void allocate_segment(kboot_loader_t *loader, kboot_itag_load_t *load,
 
 	size = ROUND_UP(size, PAGE_SIZE);
 
-	/* Allocate the exact physical address specified. */
-	phys_memory_alloc(size, 0, phys, phys + size, PHYS_MEMORY_ALLOCATED, 0, &ret);
+	/* Allocate the exact physical address specified. Preload buffers are
+	 * placed without knowing where the kernel wants to go, so if one is in
+	 * the way, free them and try again. */
+	if(!phys_memory_alloc(size, 0, phys, phys + size, PHYS_MEMORY_ALLOCATED,
+		PHYS_ALLOC_CANFAIL, &ret))
+	{
+		#if CONFIG_KBOOT_PRELOAD
+		file_preload_release_all();
+		#endif
+		phys_memory_alloc(size, 0, phys, phys + size, PHYS_MEMORY_ALLOCATED, 0, &ret);
+	}
 
 	dprintf("kboot: loading segment %zu to 0x%" PRIxPHYS " (size: 0x%" PRIx64
 		", virt: 0x%" PRIx64 ")\n", idx, phys, size, virt);
@@ -101,21 +124,50 @@ static void allocate_segment(kboot_loader_t *loader, kboot_itag_load_t *load,
 # undef KBOOT_LOAD_ELF64
 #endif
 
-/** Iterate over KBoot ELF notes.
+/** Read and cache the headers of an ELF kernel image.
  * @param loader	KBoot loader data structure.
- * @param cb		Callback function.
- * @return		Whether the file is an ELF file. */
-bool kboot_elf_note_iterate(kboot_loader_t *loader, kboot_note_cb_t cb) {
+ * @return		Whether the file is a valid ELF file. */
+bool kboot_elf_read_headers(kboot_loader_t *loader) {
+	bool ret = false;
+
+	/* Read enough for either header type, the fields that identify the
+	 * class are in the same place in both. */
+	loader->ehdr = kmalloc(sizeof(Elf64_Ehdr));
+	if(!file_read(loader->kernel, loader->ehdr, sizeof(Elf64_Ehdr), 0)) {
+		kfree(loader->ehdr);
+		loader->ehdr = NULL;
+		return false;
+	}
+
 	#if CONFIG_KBOOT_HAVE_LOADER_KBOOT32
-	if(elf_check(loader->kernel, ELFCLASS32, 0, 0))
-		return kboot_elf32_note_iterate(loader, cb);
+	if(elf_header_check(loader->ehdr, ELFCLASS32, 0, 0))
+		ret = kboot_elf32_read_headers(loader);
 	#endif
 	#if CONFIG_KBOOT_HAVE_LOADER_KBOOT64
-	if(elf_check(loader->kernel, ELFCLASS64, 0, 0))
-		return kboot_elf64_note_iterate(loader, cb);
+	if(elf_header_check(loader->ehdr, ELFCLASS64, 0, 0))
+		ret = kboot_elf64_read_headers(loader);
 	#endif
 
-	return false;
+	if(!ret) {
+		kfree(loader->ehdr);
+		loader->ehdr = NULL;
+	}
+
+	return ret;
+}
+
+/** Iterate over KBoot ELF notes.
+ * @param loader	KBoot loader data structure.
+ * @param cb		Callback function. */
+void kboot_elf_note_iterate(kboot_loader_t *loader, kboot_note_cb_t cb) {
+	#if CONFIG_KBOOT_HAVE_LOADER_KBOOT32
+	if(elf_header_check(loader->ehdr, ELFCLASS32, 0, 0))
+		kboot_elf32_note_iterate(loader, cb);
+	#endif
+	#if CONFIG_KBOOT_HAVE_LOADER_KBOOT64
+	if(elf_header_check(loader->ehdr, ELFCLASS64, 0, 0))
+		kboot_elf64_note_iterate(loader, cb);
+	#endif
 }
 
 /** Load an ELF kernel image.
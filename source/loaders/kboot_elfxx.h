@@ -35,75 +35,122 @@
 # define FUNC(name)	kboot_elf32_##name
 #endif
 
-/** Iterate over note sections in an ELF file. */
-static bool FUNC(note_iterate)(kboot_loader_t *loader, kboot_note_cb_t cb) {
+/** Read and cache the program headers and notes from an ELF file. */
+static bool FUNC(read_headers)(kboot_loader_t *loader) {
+	elf_ehdr_t *ehdr = loader->ehdr;
 	elf_phdr_t *phdrs;
-	elf_note_t *note;
-	const char *name;
-	size_t i, offset;
-	void *buf, *desc;
-	elf_ehdr_t ehdr;
+	size_t i, size;
+	void *notes;
 
-	if(!file_read(loader->kernel, &ehdr, sizeof(ehdr), 0))
+	if(ehdr->e_phentsize != sizeof(*phdrs))
 		return false;
 
-	phdrs = kmalloc(sizeof(*phdrs) * ehdr.e_phnum);
-	if(!file_read(loader->kernel, phdrs, ehdr.e_phnum * ehdr.e_phentsize, ehdr.e_phoff))
+	phdrs = kmalloc(sizeof(*phdrs) * ehdr->e_phnum);
+	if(!file_read(loader->kernel, phdrs, ehdr->e_phnum * ehdr->e_phentsize, ehdr->e_phoff)) {
+		kfree(phdrs);
 		return false;
+	}
+
+	/* Read the contents of all note segments into a single buffer. Each
+	 * segment starts on a 4 byte boundary within the buffer. */
+	for(i = 0, size = 0; i < ehdr->e_phnum; i++) {
+		if(phdrs[i].p_type == ELF_PT_NOTE)
+			size += ROUND_UP(phdrs[i].p_filesz, 4);
+	}
 
-	for(i = 0; i < ehdr.e_phnum; i++) {
+	notes = (size) ? kmalloc(size) : NULL;
+	for(i = 0, size = 0; i < ehdr->e_phnum; i++) {
 		if(phdrs[i].p_type != ELF_PT_NOTE)
 			continue;
 
-		buf = kmalloc(phdrs[i].p_filesz);
-		if(!file_read(loader->kernel, buf, phdrs[i].p_filesz, phdrs[i].p_offset))
+		if(!file_read(loader->kernel, notes + size, phdrs[i].p_filesz, phdrs[i].p_offset)) {
+			kfree(notes);
+			kfree(phdrs);
 			return false;
+		}
+
+		size += ROUND_UP(phdrs[i].p_filesz, 4);
+	}
+
+	loader->phdrs = phdrs;
+	loader->notes = notes;
+	return true;
+}
+
+/** Iterate over note sections in an ELF file. */
+static void FUNC(note_iterate)(kboot_loader_t *loader, kboot_note_cb_t cb) {
+	elf_ehdr_t *ehdr = loader->ehdr;
+	elf_phdr_t *phdrs = loader->phdrs;
+	size_t i, offset, start, end, size;
+	const char *name;
+	elf_note_t *note;
+	void *desc;
+
+	for(i = 0, start = 0; i < ehdr->e_phnum; i++) {
+		if(phdrs[i].p_type != ELF_PT_NOTE)
+			continue;
+
+		offset = start;
+		end = start + phdrs[i].p_filesz;
+		start += ROUND_UP(phdrs[i].p_filesz, 4);
+
+		/* The notes come from the kernel image, so make sure that each
+		 * one fits within the segment before using it. The sizes are
+		 * checked individually first so that rounding cannot wrap. */
+		while(end - offset >= sizeof(elf_note_t)) {
+			note = (elf_note_t *)(loader->notes + offset);
+			size = end - offset - sizeof(elf_note_t);
+			if(note->n_namesz > size || note->n_descsz > size
+				|| ROUND_UP(note->n_namesz, 4) + note->n_descsz > size)
+			{
+				dprintf("kboot: warning: ignoring truncated note in segment %zu\n", i);
+				break;
+			}
 
-		for(offset = 0; offset < phdrs[i].p_filesz; ) {
-			note = (elf_note_t *)(buf + offset);
 			offset += sizeof(elf_note_t);
-			name = (const char *)(buf + offset);
+			name = (const char *)(loader->notes + offset);
 			offset += ROUND_UP(note->n_namesz, 4);
-			desc = buf + offset;
-			offset += ROUND_UP(note->n_descsz, 4);
-
-			if(strcmp(name, "KBoot") == 0) {
-				if(!cb(note, desc, loader)) {
-					kfree(buf);
-					kfree(phdrs);
-					return true;
-				}
+			desc = loader->notes + offset;
+			offset += MIN(ROUND_UP(note->n_descsz, 4), end - offset);
+
+			/* The name is not guaranteed to be NULL-terminated. */
+			if(note->n_namesz == sizeof("KBoot") && memcmp(name, "KBoot", sizeof("KBoot")) == 0) {
+				if(!cb(note, desc, loader))
+					return;
 			}
 		}
-
-		kfree(buf);
 	}
-
-	kfree(phdrs);
-	return true;
 }
 
 /** Load an ELF kernel image. */
 static void FUNC(load_kernel)(kboot_loader_t *loader, kboot_itag_load_t *load) {
 	elf_addr_t virt_base = 0, virt_end = 0;
+	elf_ehdr_t *ehdr = loader->ehdr;
+	elf_phdr_t *phdrs = loader->phdrs;
 	phys_ptr_t phys = 0;
-	elf_phdr_t *phdrs;
-	elf_ehdr_t ehdr;
+	size_t i, size;
 	ptr_t dest;
-	size_t i;
 
-	if(!file_read(loader->kernel, &ehdr, sizeof(ehdr), 0))
-		boot_error("Could not read kernel image");
+	/* The headers and notes were cached when the configuration was loaded,
+	 * before verification began. Check them against the image as it is
+	 * hashed so that a verified image cannot have been loaded using
+	 * different ones. */
+	verify_expect(loader->kernel, ehdr, sizeof(*ehdr), 0);
+	verify_expect(loader->kernel, phdrs, ehdr->e_phnum * ehdr->e_phentsize, ehdr->e_phoff);
+	for(i = 0, size = 0; i < ehdr->e_phnum; i++) {
+		if(phdrs[i].p_type != ELF_PT_NOTE)
+			continue;
 
-	phdrs = kmalloc(sizeof(*phdrs) * ehdr.e_phnum);
-	if(!file_read(loader->kernel, phdrs, ehdr.e_phnum * ehdr.e_phentsize, ehdr.e_phoff))
-		boot_error("Could not read kernel image");
+		verify_expect(loader->kernel, loader->notes + size, phdrs[i].p_filesz,
+			phdrs[i].p_offset);
+		size += ROUND_UP(phdrs[i].p_filesz, 4);
+	}
 
 	/* If not loading at a fixed location, we allocate a single block of
 	 * physical memory to load at. */
 	if(!(load->flags & KBOOT_LOAD_FIXED)) {
 		/* Calculate the total load size of the kernel. */
-		for(i = 0; i < ehdr.e_phnum; i++) {
+		for(i = 0; i < ehdr->e_phnum; i++) {
 			if(phdrs[i].p_type != ELF_PT_LOAD)
 				continue;
 
@@ -117,7 +164,7 @@ static void FUNC(load_kernel)(kboot_loader_t *loader, kboot_itag_load_t *load) {
 	}
 
 	/* Load in the image data. */
-	for(i = 0; i < ehdr.e_phnum; i++) {
+	for(i = 0; i < ehdr->e_phnum; i++) {
 		if(phdrs[i].p_type != ELF_PT_LOAD)
 			continue;
 
@@ -138,37 +185,42 @@ static void FUNC(load_kernel)(kboot_loader_t *loader, kboot_itag_load_t *load) {
 			phdrs[i].p_memsz - phdrs[i].p_filesz);
 	}
 
-	loader->entry = ehdr.e_entry;
+	loader->entry = ehdr->e_entry;
 }
 
 /** Load additional sections from an ELF kernel image. */
 static void FUNC(load_sections)(kboot_loader_t *loader) {
+	elf_ehdr_t *ehdr = loader->ehdr;
 	kboot_tag_sections_t *tag;
 	kboot_tag_core_t *core;
-	elf_shdr_t *shdr;
-	elf_ehdr_t ehdr;
+	elf_shdr_t *shdr, *prev;
 	phys_ptr_t addr;
-	size_t size, i;
+	size_t size, count, i, j;
+	size_t *order;
 	void *dest;
 
-	if(!file_read(loader->kernel, &ehdr, sizeof(ehdr), 0))
-		boot_error("Could not read kernel image");
-
-	size = ehdr.e_shnum * ehdr.e_shentsize;
+	size = ehdr->e_shnum * ehdr->e_shentsize;
 
 	tag = kboot_allocate_tag(loader, KBOOT_TAG_SECTIONS, sizeof(*tag) + size);
-	tag->num = ehdr.e_shnum;
-	tag->entsize = ehdr.e_shentsize;
-	tag->shstrndx = ehdr.e_shstrndx;
-
-	if(!file_read(loader->kernel, tag->sections, size, ehdr.e_shoff))
+	tag->num = ehdr->e_shnum;
+	tag->entsize = ehdr->e_shentsize;
+	tag->shstrndx = ehdr->e_shstrndx;
+
+	/* The section headers are only needed once and are read straight into
+	 * the tag, so they are not cached along with the program headers. They
+	 * are usually at the end of the file, so peek at them rather than
+	 * reading up to them, so that the sections can then be read in order.
+	 * If the image is being verified they are checked when it is hashed. */
+	if(!file_peek(loader->kernel, tag->sections, size, ehdr->e_shoff))
 		boot_error("Could not read kernel image");
 
 	core = (kboot_tag_core_t *)P2V(loader->tags_phys);
 
-	/* Iterate through the headers and load in additional loadable sections. */
-	for(i = 0; i < ehdr.e_shnum; i++) {
-		shdr = (elf_shdr_t *)&tag->sections[i * ehdr.e_shentsize];
+	/* Find the additional loadable sections, sorted by their offset in the
+	 * file so that the image is read sequentially. */
+	order = kmalloc(sizeof(*order) * ehdr->e_shnum);
+	for(i = 0, count = 0; i < ehdr->e_shnum; i++) {
+		shdr = (elf_shdr_t *)&tag->sections[i * ehdr->e_shentsize];
 
 		if(shdr->sh_flags & ELF_SHF_ALLOC || shdr->sh_addr || !shdr->sh_size
 			|| (shdr->sh_type != ELF_SHT_PROGBITS
@@ -178,11 +230,33 @@ static void FUNC(load_sections)(kboot_loader_t *loader) {
 			continue;
 		}
 
+		for(j = count++; j > 0; j--) {
+			prev = (elf_shdr_t *)&tag->sections[order[j - 1] * ehdr->e_shentsize];
+			if(prev->sh_offset <= shdr->sh_offset)
+				break;
+
+			order[j] = order[j - 1];
+		}
+
+		order[j] = i;
+	}
+
+	for(j = 0; j < count; j++) {
+		i = order[j];
+		shdr = (elf_shdr_t *)&tag->sections[i * ehdr->e_shentsize];
+
 		/* Allocate memory to load the section data to. Try to make it
-		 * contiguous with the kernel image. */
-		phys_memory_alloc(ROUND_UP(shdr->sh_size, PAGE_SIZE), 0,
-			core->kernel_phys, 0, PHYS_MEMORY_ALLOCATED, 0,
-			&addr);
+		 * contiguous with the kernel image, unless it is large enough
+		 * to be worth aligning to a large page. */
+		if(!loader->large_page_size || shdr->sh_size < loader->large_page_size
+			|| !phys_memory_alloc(ROUND_UP(shdr->sh_size, PAGE_SIZE),
+				loader->large_page_size, core->kernel_phys, 0,
+				PHYS_MEMORY_ALLOCATED, PHYS_ALLOC_CANFAIL, &addr))
+		{
+			phys_memory_alloc(ROUND_UP(shdr->sh_size, PAGE_SIZE), 0,
+				core->kernel_phys, 0, PHYS_MEMORY_ALLOCATED, 0,
+				&addr);
+		}
 		shdr->sh_addr = addr;
 
 		/* Load in the section data. */
@@ -197,6 +271,8 @@ static void FUNC(load_sections)(kboot_loader_t *loader) {
 		dprintf("kboot: loaded ELF section %zu to 0x%" PRIxPHYS " (size: %zu)\n",
 			i, addr, (size_t)shdr->sh_size);
 	}
+
+	kfree(order);
 }
 
 #undef elf_ehdr_t
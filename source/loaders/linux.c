@@ -28,7 +28,9 @@
  *   linux "<kernel path>" ["<initrd path>"]
  *
  * This loads the kernel and an optional initrd. The kernel command line is
- * set through the cmdline environment variable.
+ * set through the cmdline environment variable. Expected digests for the
+ * kernel and initrd can be given through the sha256 environment variable
+ * (see verify.c).
  */
 
 #include <lib/string.h>
@@ -40,6 +42,7 @@
 #include <loader.h>
 #include <memory.h>
 #include <ui.h>
+#include <verify.h>
 
 /** Structure containing Linux kernel loading arguments. */
 typedef struct linux_loader {
@@ -60,10 +63,14 @@ static __noreturn void linux_loader_load(void) {
 	if(!kernel)
 		boot_error("Failed to open kernel image");
 
+	verify_begin(kernel, data->kernel, NULL);
+
 	if(data->initrd) {
 		initrd = file_open(data->initrd, NULL);
 		if(!initrd)
 			boot_error("Failed to open initrd");
+
+		verify_begin(initrd, data->initrd, NULL);
 	}
 
 	cmdline = environ_lookup(current_environ, "cmdline");
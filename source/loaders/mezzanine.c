@@ -24,9 +24,14 @@
  *
  *   mezzanine "<device name>"
  *
+ * Expected digests for modules can be given through the sha256 environment
+ * variable (see verify.c). The image itself is paged in from the device on
+ * demand rather than read as a file, so it is not verified.
+ *
  * @todo		Modules
  */
 
+#include <lib/lz4.h>
 #include <lib/string.h>
 #include <lib/utility.h>
 
@@ -42,7 +47,9 @@
 #include <loader.h>
 #include <memory.h>
 #include <mmu.h>
+#include <trace.h>
 #include <ui.h>
+#include <verify.h>
 
 typedef struct mezzanine_extent {
 	uint64_t virtual_base;
@@ -88,7 +95,16 @@ typedef struct mezzanine_memory_map_entry {
 
 static const char mezzanine_magic[] = "\x00MezzanineImage\x00";
 static const uint16_t mezzanine_protocol_major = 0;
-static const uint16_t mezzanine_protocol_minor = 20;
+// Minor 22: Fully present 2MB-aligned regions of extents are mapped with
+// 2MB pages.
+// Minor 23: Memory map grown to 128 entries, moving the timing fields.
+// Minor 24: Block map entries may refer to pages in LZ4-compressed groups.
+// Pages loaded from a group have no block of their own, so they are not
+// marked as cached and their bin is 0.
+// Minor 25: Timing phases are all start markers, with mmu before modules.
+// Minor 26: The physical map may be mapped with 1GB pages when the CPU
+// supports them.
+static const uint16_t mezzanine_protocol_minor = 26;
 // FIXME: Duplicated in enter.S
 static const uint64_t mezzanine_physical_map_address = 0xFFFF800000000000ull;
 static const uint64_t mezzanine_physical_info_address = 0xFFFF808000000000ull;
@@ -100,8 +116,11 @@ static const uint64_t mezzanine_physical_map_size = 0x8000000000ull;
 #define mezzanine_n_buddy_bins_32_bit (32-log2_4k_page)
 // The physical map covers 512GB, log2 is 39.
 #define mezzanine_n_buddy_bins_64_bit (39-log2_4k_page)
-// I have yet to see an E820 memory map with more than 16 entries.
-#define mezzanine_max_memory_map_size 32
+// Desktops rarely have more than 16 E820 entries, but servers with NUMA
+// holes and many reserved ranges can have far more, even after merging.
+#define mezzanine_max_memory_map_size 128
+// Entry, memory, disk, config, menu, kernel, mmu, modules, handoff.
+#define mezzanine_n_timing_phases 9
 
 /* Boot info page */
 
@@ -144,20 +163,57 @@ typedef struct mezzanine_boot_information {
 	// This is sorted in address order, with no overlaps.
 	uint64_t n_memory_map_entries;                             // +904 unsigned-byte 64.
 	mezzanine_memory_map_entry_t memory_map[mezzanine_max_memory_map_size];
+	// Boot phase timestamps, from the TSC. Indexed by trace_phase_t, 0 if
+	// the phase was not reached. Entry includes the time spent in firmware.
+	uint64_t timing_frequency;                                 // +2880 unsigned-byte 64, Hz.
+	uint64_t timing[mezzanine_n_timing_phases];                // +2888 unsigned-byte 64.
 } __packed mezzanine_boot_information_t;
 
 #define BLOCK_MAP_PRESENT 1
 #define BLOCK_MAP_WRITABLE 2
 #define BLOCK_MAP_ZERO_FILL 4
+// The block id refers to a compressed group, the page's index within the
+// group is in the group index bits.
+#define BLOCK_MAP_COMPRESSED 8
+#define BLOCK_MAP_GROUP_INDEX_MASK 0xF0
+#define BLOCK_MAP_GROUP_INDEX_SHIFT 4
 #define BLOCK_MAP_FLAG_MASK 0xFF
 #define BLOCK_MAP_ID_SHIFT 8
 
+// Header of a compressed group, followed by LZ4 block format data. A group
+// holds up to 16 pages (64KB) and occupies as many blocks as needed for the
+// header plus the compressed data.
+typedef struct mezzanine_compressed_group {
+	uint32_t compressed_size;               // Size of the LZ4 data.
+	uint32_t uncompressed_size;             // Size once decompressed, a multiple of the page size.
+} __packed mezzanine_compressed_group_t;
+
+#define COMPRESSED_GROUP_MAX_SIZE 0x10000
+// Worst case LZ4 expansion of a group, plus the header, in whole blocks.
+#define COMPRESSED_GROUP_MAX_BLOCKS ((sizeof(mezzanine_compressed_group_t) + COMPRESSED_GROUP_MAX_SIZE + COMPRESSED_GROUP_MAX_SIZE / 255 + 16 + 0xFFF) / 0x1000)
+
+// Maximum number of block map blocks held in the cache. Each one takes a
+// page, so this bounds the cache at 256KB.
+#define BLOCK_CACHE_SIZE 64
+// Number of hash buckets in the block cache. Must be a power of two.
+#define BLOCK_CACHE_BUCKETS 64
+
 typedef struct block_cache_entry {
+	list_t lru;                             // Link to the LRU list.
+	struct block_cache_entry *hash_next;    // Next entry in the hash bucket.
 	uint64_t block;
 	void *data;
-	struct block_cache_entry *next;
 } block_cache_entry_t;
 
+// A sequence of consecutive image blocks to be read into contiguous memory,
+// or a single page to be extracted from a compressed group.
+typedef struct load_segment {
+	uint64_t block;                         // First image block, or the group.
+	phys_ptr_t phys;                        // Physical address to read to.
+	uint32_t count;                         // Number of blocks, 0 if compressed.
+	uint32_t index;                         // Page index within the group.
+} load_segment_t;
+
 /** Structure containing Mezzanine image loader state. */
 typedef struct mezzanine_loader {
 	disk_t *disk;			/**< Image device. */
@@ -166,59 +222,145 @@ typedef struct mezzanine_loader {
 	mezzanine_header_t header;
 	value_t modules;		/**< Modules to load. */
 
-	block_cache_entry_t *block_cache;
+	// Block map cache. The LRU list is ordered most recently used first.
+	block_cache_entry_t *block_cache[BLOCK_CACHE_BUCKETS];
+	list_t block_cache_lru;
+	size_t block_cache_count;
+	// Level 2 block map covering the most recently looked up 1GB region.
+	uint64_t last_bml2_region;
+	uint64_t last_bml2_block;
+	// Reads queued while walking the extents, issued in disk order.
+	load_segment_t *segments;
+	size_t n_segments;
+	size_t max_segments;
+	// Buffers for compressed groups, and the group currently decompressed.
+	void *group_in;
+	void *group_out;
+	uint64_t group_block;
+	size_t group_size;
 } mezzanine_loader_t;
 
 extern void __noreturn mezzanine_arch_enter(phys_ptr_t transition_pml4, phys_ptr_t pml4, uint64_t entry_fref, uint64_t initial_process, uint64_t boot_information_location);
 
-static bool in_range(uint64_t start, uint64_t end, uint64_t value) {
-	return start <= value && value <= end;
-}
-
 static void crunch_memory_map(mezzanine_boot_information_t *boot_info) {
-	// Merge all overlapping/contiguous regions in the memory map.
-	// insert_into_memory_map may produce opportunities for merging.
+	// The memory map is full. Free up an entry by merging the two entries
+	// with the smallest gap between them. The gap gets info structs that will
+	// never be used, but no RAM is dropped from the map.
+	uint64_t best = 0;
+	for(uint64_t i = 1; i < boot_info->n_memory_map_entries - 1; i += 1) {
+		if(boot_info->memory_map[i+1].start - boot_info->memory_map[i].end <
+		   boot_info->memory_map[best+1].start - boot_info->memory_map[best].end) {
+			best = i;
+		}
+	}
+
+	dprintf("mezzanine: Memory map full, merging %016" PRIx64 "-%016" PRIx64 " with %016" PRIx64 "-%016" PRIx64 "\n",
+		boot_info->memory_map[best].start, boot_info->memory_map[best].end,
+		boot_info->memory_map[best+1].start, boot_info->memory_map[best+1].end);
 
-	// TODO.
+	boot_info->memory_map[best].end = boot_info->memory_map[best+1].end;
+	memmove(&boot_info->memory_map[best+1], &boot_info->memory_map[best+2], (boot_info->n_memory_map_entries - best - 2) * sizeof(mezzanine_memory_map_entry_t));
+	boot_info->n_memory_map_entries -= 1;
 }
 
 static void insert_into_memory_map(mezzanine_boot_information_t *boot_info, uint64_t start, uint64_t end) {
-	// Search for a existing region to merge with/insert after.
-	uint64_t i = 0;
-	for(; i < boot_info->n_memory_map_entries; i += 1) {
-		if(boot_info->memory_map[i].start > end) {
-			// Insert before this entry.
-			break;
+	// Regions are inserted in order of start address, so the new region can
+	// only overlap or touch the last entry.
+	uint64_t n = boot_info->n_memory_map_entries;
+	if(n != 0 && start <= boot_info->memory_map[n-1].end) {
+		if(boot_info->memory_map[n-1].end < end) {
+			boot_info->memory_map[n-1].end = end;
 		}
-		// Merge entries when the new region overlaps.
-		if(in_range(boot_info->memory_map[i].start, boot_info->memory_map[i].end, start) ||
-		   in_range(boot_info->memory_map[i].start, boot_info->memory_map[i].end, end)) {
-			if(boot_info->memory_map[i].start > start) {
-				boot_info->memory_map[i].start = start;
-			}
-			if(boot_info->memory_map[i].end < end) {
-				boot_info->memory_map[i].end = end;
-			}
-			crunch_memory_map(boot_info);
-			return;
+		return;
+	}
+	// Can't merge with an existing entry. Append a new region.
+	if(n == mezzanine_max_memory_map_size) {
+		crunch_memory_map(boot_info);
+		n -= 1;
+	}
+	boot_info->memory_map[n].start = start;
+	boot_info->memory_map[n].end = end;
+	boot_info->n_memory_map_entries = n + 1;
+}
+
+// Sort the E820 map by start address. Firmware almost always returns it
+// sorted already, so an insertion sort is the right tool.
+static void sort_e820_map(e820_entry_t *mmap, size_t count) {
+	for(size_t i = 1; i < count; i++) {
+		e820_entry_t entry = mmap[i];
+		size_t j = i;
+		while(j > 0 && mmap[j-1].start > entry.start) {
+			mmap[j] = mmap[j-1];
+			j--;
 		}
+		mmap[j] = entry;
 	}
-	// Can't merge with an existing entry. Insert a new region.
-	if(boot_info->n_memory_map_entries == mezzanine_max_memory_map_size) {
-		dprintf("Too many memory map entries. Ignoring %016" PRIx64 "-%016" PRIx64 "\n",
-			start, end);
-		return;
+}
+
+// Zero a page-aligned block of memory. The page info arrays and zero-fill
+// pages can be gigabytes. memset is a rep stosb, which writes through the
+// cache. Non-temporal stores are used instead so that clearing does not
+// evict everything else from the cache, as the loader does not read the
+// memory back. MOVNTI only needs SSE2, which every 64-bit CPU has.
+static void zero_pages(void *dest, size_t size) {
+	uint32_t *p = dest;
+	uint32_t *end = p + size / 4;
+	uint32_t zero = 0;
+
+	for(; p < end; p += 4) {
+		asm volatile("movnti %1, 0(%0)\n\t"
+			     "movnti %1, 4(%0)\n\t"
+			     "movnti %1, 8(%0)\n\t"
+			     "movnti %1, 12(%0)"
+			     :: "r"(p), "r"(zero)
+			     : "memory");
 	}
-	// Shuffle entries up.
-	memmove(&boot_info->memory_map[i+1], &boot_info->memory_map[i], (boot_info->n_memory_map_entries - i) * sizeof(mezzanine_memory_map_entry_t));
-	// Set.
-	boot_info->memory_map[i].start = start;
-	boot_info->memory_map[i].end = end;
-	boot_info->n_memory_map_entries += 1;
 
-	crunch_memory_map(boot_info);
+	// Make the stores visible before the memory is used.
+	asm volatile("sfence" ::: "memory");
 }
 
+// Back a range of the page info region with zeroed memory.
+// The range is backed one 2MB chunk at a time, using a 2MB page wherever a
+// chunk is fully covered and a 2MB-aligned block of memory is free, so the
+// backing memory does not need to be contiguous.
+static void map_page_info(mmu_context_t *mmu, uint64_t info_start, uint64_t info_end) {
+	uint64_t virtual = info_start;
+	while(virtual < info_end) {
+		uint64_t size = MIN(ROUND_DOWN(virtual, 0x200000) + 0x200000, info_end) - virtual;
+		phys_ptr_t phys_addr;
+
+		bool allocated = false;
+		if(size == 0x200000) {
+			allocated = phys_memory_alloc(0x200000, // size
+						      0x200000, // alignment
+						      0x100000, 0, // min/max address
+						      PHYS_MEMORY_ALLOCATED, // type
+						      PHYS_ALLOC_CANFAIL, // flags
+						      &phys_addr);
+		}
+		if(!allocated &&
+		   !phys_memory_alloc(size, // size
+				      0x1000, // alignment
+				      0x100000, 0, // min/max address
+				      PHYS_MEMORY_ALLOCATED, // type
+				      PHYS_ALLOC_CANFAIL, // flags
+				      &phys_addr)) {
+			// No contiguous block for the chunk, use a single page.
+			size = PAGE_SIZE;
+			phys_memory_alloc(PAGE_SIZE, // size
+					  0x1000, // alignment
+					  0x100000, 0, // min/max address
+					  PHYS_MEMORY_ALLOCATED, // type
+					  0, // flags
+					  &phys_addr);
+		}
+
+		mmu_map(mmu, virtual, phys_addr, size);
+		zero_pages((void *)P2V(phys_addr), size);
+		virtual += size;
+	}
+}
 
 static void generate_memory_map(mmu_context_t *mmu, mezzanine_boot_information_t *boot_info) {
 	// Iterate the E820 memory map to generate the physical mapping region.
@@ -248,7 +390,9 @@ static void generate_memory_map(mmu_context_t *mmu, mezzanine_boot_information_t
 			break;
 
 		count++;
-	} while(regs.ebx != 0);
+	} while(regs.ebx != 0 && count < BIOS_MEM_SIZE / sizeof(e820_entry_t));
+
+	sort_e820_map(mmap, count);
 
 	for(i = 0; i < count; i++) {
 		// Map liberally, it doesn't matter if free regions overlap with allocated
@@ -278,7 +422,7 @@ static void generate_memory_map(mmu_context_t *mmu, mezzanine_boot_information_t
 		// Map the memory into the physical map region.
 		mmu_map(mmu, mezzanine_physical_map_address + start, start, end - start);
 
-		// Carefully insert it into the memory map, maintaining the sortedness.
+		// Add it to the memory map, merging with the previous region.
 		insert_into_memory_map(boot_info, start, end);
 	}
 
@@ -290,24 +434,21 @@ static void generate_memory_map(mmu_context_t *mmu, mezzanine_boot_information_t
 	}
 
 	// Allocate the information structs for all the pages in the memory map.
-	// FIXME: This has a bit of a problem with overlap, leaking a few pages.
+	// Neighbouring regions can have their info structs on the same page, skip
+	// anything already allocated for the previous region.
+	phys_ptr_t prev_info_end = 0;
 	for(uint64_t i = 0; i < boot_info->n_memory_map_entries; i += 1) {
 		phys_ptr_t start = boot_info->memory_map[i].start;
 		phys_ptr_t end = boot_info->memory_map[i].end;
 		phys_ptr_t info_start = ROUND_DOWN((mezzanine_physical_info_address + (start / PAGE_SIZE) * sizeof(mezzanine_page_info_t)), PAGE_SIZE);
 		phys_ptr_t info_end = ROUND_UP((mezzanine_physical_info_address + (end / PAGE_SIZE) * sizeof(mezzanine_page_info_t)), PAGE_SIZE);
-		phys_ptr_t phys_info_addr;
+		info_start = MAX(info_start, prev_info_end);
+		prev_info_end = info_end;
+		if(info_start >= info_end) {
+			continue;
+		}
 		dprintf("mezzanine: info range %016" PRIx64 "-%016" PRIx64 "\n", info_start, info_end);
-		// FIXME/TODO: It's ok for the backing pages to be discontinuous.
-		// Could use 2MB pages here as well.
-		phys_memory_alloc(info_end - info_start, // size
-				  0x1000, // alignment
-				  0x100000, 0, // min/max address
-				  PHYS_MEMORY_ALLOCATED, // type
-				  0, // flags
-				  &phys_info_addr);
-		mmu_map(mmu, info_start, phys_info_addr, info_end - info_start);
-		memset((void *)P2V(phys_info_addr), 0, info_end - info_start);
+		map_page_info(mmu, info_start, info_end);
 	}
 }
 
@@ -324,25 +465,11 @@ static int64_t unfixnum(uint64_t fix) {
 #define PAGE_FLAG_CACHE 2
 #define PAGE_FLAG_WRITEBACK 4
 
-static uint64_t page_info_flags(mmu_context_t *mmu, phys_ptr_t page) {
-	uint64_t offset = page / PAGE_SIZE;
-	uint64_t result;
-	mmu_memcpy_from(mmu, &result, mezzanine_physical_info_address + offset * sizeof(mezzanine_page_info_t) + offsetof(mezzanine_page_info_t, flags), sizeof result);
-	return result;
-}
-
 static void set_page_info_flags(mmu_context_t *mmu, phys_ptr_t page, uint64_t value) {
 	uint64_t offset = page / PAGE_SIZE;
 	mmu_memcpy_to(mmu, mezzanine_physical_info_address + offset * sizeof(mezzanine_page_info_t) + offsetof(mezzanine_page_info_t, flags), &value, sizeof value);
 }
 
-static uint64_t page_info_bin(mmu_context_t *mmu, phys_ptr_t page) {
-	uint64_t offset = page / PAGE_SIZE;
-	uint64_t result;
-	mmu_memcpy_from(mmu, &result, mezzanine_physical_info_address + offset * sizeof(mezzanine_page_info_t) + offsetof(mezzanine_page_info_t, bin), sizeof result);
-	return result;
-}
-
 static void set_page_info_bin(mmu_context_t *mmu, phys_ptr_t page, uint64_t value) {
 	uint64_t offset = page / PAGE_SIZE;
 	mmu_memcpy_to(mmu, mezzanine_physical_info_address + offset * sizeof(mezzanine_page_info_t) + offsetof(mezzanine_page_info_t, bin), &value, sizeof value);
@@ -367,83 +494,61 @@ static uint64_t page_info_prev(mmu_context_t *mmu, phys_ptr_t page) {
 	return result;
 }
 
-static void set_page_info_prev(mmu_context_t *mmu, phys_ptr_t page, uint64_t value) {
-	uint64_t offset = page / PAGE_SIZE;
-	mmu_memcpy_to(mmu, mezzanine_physical_info_address + offset * sizeof(mezzanine_page_info_t) + offsetof(mezzanine_page_info_t, prev), &value, sizeof value);
-}
-
-static phys_ptr_t buddy(int k, phys_ptr_t x) {
-	return x ^ ((phys_ptr_t)1 << (k + log2_4k_page));
-}
-
-static bool page_exists(mezzanine_boot_information_t *boot_info, phys_ptr_t page) {
-	for(uint64_t i = 0; i < boot_info->n_memory_map_entries; i += 1) {
-		if(boot_info->memory_map[i].start <= page && page < boot_info->memory_map[i].end) {
-			return true;
-		}
-	}
-	return false;
-}
-
-static void buddy_free_page(mmu_context_t *mmu, mezzanine_boot_information_t *boot_info, uint64_t nil, phys_ptr_t l) {
-	//phys_ptr_t orig = l;
-	mezzanine_buddy_bin_t *buddies;
-	int m;
-	int k = 0;
-
-	if(l < 0x100000000ull) { // 4GB
-		m = mezzanine_n_buddy_bins_32_bit - 1;
-		buddies = boot_info->buddy_bin_32;
+// Add a free block of 2^order pages to the tail of a buddy bin.
+// The block's page info is written in one go, then the previous tail (if
+// any) is linked to it. Keeping bins in address order means no page info
+// ever has to be read back.
+static void buddy_append_block(mmu_context_t *mmu, mezzanine_buddy_bin_t *bin, phys_ptr_t *tail, uint64_t nil, phys_ptr_t block, int order) {
+	mezzanine_page_info_t info;
+	info.flags = fixnum(PAGE_FLAG_FREE);
+	info.bin = fixnum(order);
+	info.next = nil;
+	info.prev = (bin->first_page == nil) ? nil : fixnum(*tail / PAGE_SIZE);
+	mmu_memcpy_to(mmu, mezzanine_physical_info_address + (block / PAGE_SIZE) * sizeof(mezzanine_page_info_t), &info, sizeof info);
+
+	if(bin->first_page == nil) {
+		bin->first_page = fixnum(block / PAGE_SIZE);
 	} else {
-		m = mezzanine_n_buddy_bins_64_bit - 1;
-		buddies = boot_info->buddy_bin_64;
+		set_page_info_next(mmu, *tail, fixnum(block / PAGE_SIZE));
 	}
+	*tail = block;
+	bin->count += fixnum(1);
+}
 
-	//if(orig > 0x000000013FF00000ull)
-	//	dprintf("Freeing page %016" PRIx64 "\n", l);
-
-	while(1) {
-		phys_ptr_t p = buddy(k, l);
-		//if(orig > 0x000000013FF00000ull)
-		//	dprintf(" buddy %016" PRIx64 "  order %i\n", p, k);
-
-		if(k == m || // Stop trying to combine at the last bin.
-		   !page_exists(boot_info, p) || // Stop when the buddy doesn't actually exist.
-		   // Don't combine if buddy is not free
-		   (page_info_flags(mmu, p) & fixnum(PAGE_FLAG_FREE)) != fixnum(PAGE_FLAG_FREE) ||
-		   // Only combine when the buddy is in this bin.
-		   ((page_info_flags(mmu, p) & fixnum(PAGE_FLAG_FREE)) == fixnum(PAGE_FLAG_FREE) &&
-		    page_info_bin(mmu, p) != fixnum(k))) {
-			break;
-		}
-		// remove buddy from avail[k]
-		if(buddies[k].first_page == fixnum(p / PAGE_SIZE)) {
-			buddies[k].first_page = page_info_next(mmu, p);
-		}
-		if(page_info_next(mmu, p) != nil) {
-			set_page_info_prev(mmu, unfixnum(page_info_next(mmu, p)) * PAGE_SIZE, page_info_prev(mmu, p));
-		}
-		if(page_info_prev(mmu, p) != nil) {
-			set_page_info_next(mmu, unfixnum(page_info_prev(mmu, p)) * PAGE_SIZE, page_info_next(mmu, p));
+// Add a range of free memory to the buddy allocator.
+// The range is split into maximal naturally aligned power-of-two blocks,
+// which is exactly what freeing each page and merging buddies would give.
+// Ranges must be added in address order.
+static void buddy_free_range(mmu_context_t *mmu, mezzanine_boot_information_t *boot_info, uint64_t nil, phys_ptr_t *tails_32, phys_ptr_t *tails_64, phys_ptr_t start, phys_ptr_t end) {
+	while(start < end) {
+		mezzanine_buddy_bin_t *buddies;
+		phys_ptr_t *tails;
+		int m;
+
+		// Blocks never cross 4GB, the largest 32-bit block is 2GB.
+		if(start < 0x100000000ull) { // 4GB
+			m = mezzanine_n_buddy_bins_32_bit - 1;
+			buddies = boot_info->buddy_bin_32;
+			tails = tails_32;
+		} else {
+			m = mezzanine_n_buddy_bins_64_bit - 1;
+			buddies = boot_info->buddy_bin_64;
+			tails = tails_64;
 		}
-		buddies[k].count -= fixnum(1);
-		k += 1;
-		if(p < l) {
-			l = p;
+
+		// Grow the block while it stays aligned and inside the range.
+		int k = 0;
+		while(k < m) {
+			phys_ptr_t size = (phys_ptr_t)1 << (k + 1 + log2_4k_page);
+			if(start & (size - 1) || end - start < size) {
+				break;
+			}
+			k += 1;
 		}
-	}
-	//if(orig > 0x000000013FF00000ull)
-	//	dprintf(" final %016" PRIx64 "\n", l);
 
-	set_page_info_flags(mmu, l, page_info_flags(mmu, l) | fixnum(PAGE_FLAG_FREE));
-	set_page_info_bin(mmu, l, fixnum(k));
-	set_page_info_next(mmu, l, buddies[k].first_page);
-	set_page_info_prev(mmu, l, nil);
-	if(buddies[k].first_page != nil) {
-		set_page_info_prev(mmu, unfixnum(buddies[k].first_page) * PAGE_SIZE, fixnum(l / PAGE_SIZE));
+		buddy_append_block(mmu, &buddies[k], &tails[k], nil, start, k);
+		start += (phys_ptr_t)1 << (k + log2_4k_page);
 	}
-	buddies[k].first_page = fixnum(l / PAGE_SIZE);
-	buddies[k].count += fixnum(1);
 }
 
 static int determine_vbe_mode_layout(vbe_mode_t *mode) {
@@ -549,7 +654,7 @@ static void set_video_mode(mezzanine_boot_information_t *boot_info)
 	vbe_mode_set(mode);
 }
 
-static void load_module(phys_ptr_t current, file_handle_t *handle, const char *name) {
+static void load_module(phys_ptr_t current, file_handle_t *handle, const char *name, const char *path) {
 	if(handle->directory) {
 		boot_error("%s is a directory.", name);
 	}
@@ -561,49 +666,73 @@ static void load_module(phys_ptr_t current, file_handle_t *handle, const char *n
 	phys_ptr_t addr;
 	phys_memory_alloc(ROUND_UP(size, PAGE_SIZE), 0, 0x100000, 0, PHYS_MEMORY_ALLOCATED,
 		0, &addr);
+	verify_begin(handle, path, NULL);
 	if(!file_read(handle, (void *)P2V(addr), size, 0)) {
 		boot_error("Could not read module '%s'", name);
 	}
+	verify_end(handle, name);
 
 	size_t name_size = strlen(name);
 
-	((uint64_t *)(uint32_t)current)[0] = fixnum(addr);
-	((uint64_t *)(uint32_t)current)[1] = fixnum(size);
-	((uint64_t *)(uint32_t)current)[2] = fixnum(name_size);
+	((uint64_t *)P2V(current))[0] = fixnum(addr);
+	((uint64_t *)P2V(current))[1] = fixnum(size);
+	((uint64_t *)P2V(current))[2] = fixnum(name_size);
 
-	memcpy((char *)((uint32_t)current + 24), name, name_size);
+	memcpy((char *)P2V(current + 24), name, name_size);
 
 	dprintf("mezzanine: loaded module %s to 0x%" PRIxPHYS " (size: %" PRIu64 ")\n",
 		name, addr, size);
 }
 
+static size_t block_cache_hash(uint64_t block_id) {
+	return (size_t)(block_id ^ (block_id >> 6)) & (BLOCK_CACHE_BUCKETS - 1);
+}
+
+// Read a block map block through the cache.
+// The returned pointer is only valid until the next call, as the entry may
+// be evicted to make room for another block.
 static void *read_cached_block(mezzanine_loader_t *loader, uint64_t block_id) {
-	block_cache_entry_t **prev = &loader->block_cache;
-	for(block_cache_entry_t *e = loader->block_cache; e; e = e->next) {
+	block_cache_entry_t **bucket = &loader->block_cache[block_cache_hash(block_id)];
+	block_cache_entry_t *e;
+	for(e = *bucket; e; e = e->hash_next) {
 		if(e->block == block_id) {
 			// Bring recently used blocks to the front of the list.
-			*prev = e->next;
-			e->next = loader->block_cache;
-			loader->block_cache = e;
+			list_remove(&e->lru);
+			list_prepend(&loader->block_cache_lru, &e->lru);
 			return e->data;
 		}
-		prev = &e->next;
 	}
-	// Not present in cache. Read from disk.
-	block_cache_entry_t *e = kmalloc(sizeof(block_cache_entry_t));
-	e->next = loader->block_cache;
-	loader->block_cache = e;
-	e->block = block_id;
 
-	// Heap is fixed-size, use pages directly.
-	phys_ptr_t phys_addr;
-	phys_memory_alloc(0x1000, // size
-			  0x1000, // alignment
-			  0, 0, // min/max address
-			  PHYS_MEMORY_INTERNAL, // type
-			  0, // flags
-			  &phys_addr);
-	e->data = (void *)P2V(phys_addr);
+	// Not present in cache. Reuse the least recently used entry if the cache
+	// is full, otherwise allocate a new one.
+	if(loader->block_cache_count == BLOCK_CACHE_SIZE) {
+		e = list_entry(loader->block_cache_lru.prev, block_cache_entry_t, lru);
+		list_remove(&e->lru);
+		block_cache_entry_t **prev = &loader->block_cache[block_cache_hash(e->block)];
+		while(*prev != e) {
+			prev = &(*prev)->hash_next;
+		}
+		*prev = e->hash_next;
+	} else {
+		e = kmalloc(sizeof(block_cache_entry_t));
+		list_init(&e->lru);
+
+		// Heap is fixed-size, use pages directly.
+		phys_ptr_t phys_addr;
+		phys_memory_alloc(0x1000, // size
+				  0x1000, // alignment
+				  0, 0, // min/max address
+				  PHYS_MEMORY_INTERNAL, // type
+				  0, // flags
+				  &phys_addr);
+		e->data = (void *)P2V(phys_addr);
+		loader->block_cache_count++;
+	}
+
+	e->block = block_id;
+	e->hash_next = *bucket;
+	*bucket = e;
+	list_prepend(&loader->block_cache_lru, &e->lru);
 
 	if(!disk_read(loader->disk,
 		      e->data,
@@ -615,56 +744,376 @@ static void *read_cached_block(mezzanine_loader_t *loader, uint64_t block_id) {
 	return e->data;
 }
 
-static uint64_t read_info_for_page(mezzanine_loader_t *loader, uint64_t virtual) {
+// Find the level 2 block map covering a virtual address.
+// Returns NULL if no pages in the 1GB region are present. The block id of
+// the last level 2 map found is remembered, as extents are walked in address
+// order and almost always stay within the same 1GB region.
+static uint64_t *read_block_map_l2(mezzanine_loader_t *loader, uint64_t virtual) {
+	uint64_t region = virtual >> 30;
+	if(loader->last_bml2_block && loader->last_bml2_region == region) {
+		return read_cached_block(loader, loader->last_bml2_block);
+	}
+
 	// Indices into each level of the block map.
 	uint64_t bml4i = (virtual >> 39) & 0x1FF;
 	uint64_t bml3i = (virtual >> 30) & 0x1FF;
-	uint64_t bml2i = (virtual >> 21) & 0x1FF;
-	uint64_t bml1i = (virtual >> 12) & 0x1FF;
 	uint64_t *bml4 = read_cached_block(loader, loader->header.bml4);
 	if((bml4[bml4i] & BLOCK_MAP_PRESENT) == 0) {
-		return 0;
+		return NULL;
 	}
 	uint64_t *bml3 = read_cached_block(loader, bml4[bml4i] >> BLOCK_MAP_ID_SHIFT);
 	if((bml3[bml3i] & BLOCK_MAP_PRESENT) == 0) {
-		return 0;
+		return NULL;
 	}
-	uint64_t *bml2 = read_cached_block(loader, bml3[bml3i] >> BLOCK_MAP_ID_SHIFT);
-	if((bml2[bml2i] & BLOCK_MAP_PRESENT) == 0) {
-		return 0;
+	loader->last_bml2_region = region;
+	loader->last_bml2_block = bml3[bml3i] >> BLOCK_MAP_ID_SHIFT;
+	return read_cached_block(loader, loader->last_bml2_block);
+}
+
+// Find the level 1 block map covering a virtual address.
+// Returns NULL if no pages in the 2MB region are present.
+static uint64_t *read_block_map_l1(mezzanine_loader_t *loader, uint64_t virtual) {
+	uint64_t bml2i = (virtual >> 21) & 0x1FF;
+	uint64_t *bml2 = read_block_map_l2(loader, virtual);
+	if(!bml2 || (bml2[bml2i] & BLOCK_MAP_PRESENT) == 0) {
+		return NULL;
 	}
-	uint64_t *bml1 = read_cached_block(loader, bml2[bml2i] >> BLOCK_MAP_ID_SHIFT);
-	return bml1[bml1i];
+	return read_cached_block(loader, bml2[bml2i] >> BLOCK_MAP_ID_SHIFT);
 }
 
-static void load_page(mezzanine_loader_t *loader, mmu_context_t *mmu, uint64_t virtual) {
-	uint64_t info = read_info_for_page(loader, virtual);
-	if((info & BLOCK_MAP_PRESENT) == 0) {
-		return;
+// Queue a read of consecutive image blocks into contiguous memory.
+static void queue_segment(mezzanine_loader_t *loader, uint64_t block, phys_ptr_t phys, uint32_t count, uint32_t index) {
+	if(loader->n_segments == loader->max_segments) {
+		// The heap is fixed-size, use pages directly. Double the size of the
+		// array and release the old one.
+		size_t size = ROUND_UP(MAX(loader->max_segments * 2, 256) * sizeof(load_segment_t), PAGE_SIZE);
+		phys_ptr_t phys_addr;
+		phys_memory_alloc(size, // size
+				  0x1000, // alignment
+				  0, 0, // min/max address
+				  PHYS_MEMORY_INTERNAL, // type
+				  0, // flags
+				  &phys_addr);
+		load_segment_t *segments = (load_segment_t *)P2V(phys_addr);
+		if(loader->segments) {
+			memcpy(segments, loader->segments, loader->n_segments * sizeof(load_segment_t));
+			phys_memory_add(V2P((ptr_t)loader->segments),
+					ROUND_UP(loader->max_segments * sizeof(load_segment_t), PAGE_SIZE),
+					PHYS_MEMORY_FREE);
+		}
+		loader->segments = segments;
+		loader->max_segments = size / sizeof(load_segment_t);
 	}
 
-	// Alloc phys.
+	load_segment_t *segment = &loader->segments[loader->n_segments++];
+	segment->block = block;
+	segment->phys = phys;
+	segment->count = count;
+	segment->index = index;
+}
+
+// Load a run of virtually contiguous present pages.
+// The run is given physically contiguous memory and mapped with a single
+// mmu_map call. Each sequence of zero-fill pages is cleared in bulk, and each
+// sequence of consecutive image blocks is queued to be read later in disk
+// order.
+static void load_run(mezzanine_loader_t *loader, mmu_context_t *mmu, uint64_t virtual, const uint64_t *info, size_t count) {
 	phys_ptr_t phys_addr;
-	phys_memory_alloc(PAGE_SIZE, // size
-			  0x1000, // alignment
-			  0x100000, 0, // min/max address
-			  PHYS_MEMORY_ALLOCATED, // type
-			  0, // flags
-			  &phys_addr);
-	// Map...
-	mmu_map(mmu, virtual, phys_addr, PAGE_SIZE);
-	// Write block number to page info struct.
-	set_page_info_bin(mmu, phys_addr, fixnum(info >> BLOCK_MAP_ID_SHIFT));
-	set_page_info_flags(mmu, phys_addr, fixnum(virtual & ~0xFFF) | fixnum(PAGE_FLAG_CACHE));
-
-	if(info & BLOCK_MAP_ZERO_FILL) {
-		memset((void *)P2V(phys_addr), 0, PAGE_SIZE);
-	} else {
+
+	// If the run covers a whole 2MB-aligned region, try to give it 2MB-aligned
+	// physical memory so that mmu_map uses a large page for it.
+	bool allocated = false;
+	if(virtual % 0x200000 == 0 && count * PAGE_SIZE == 0x200000) {
+		allocated = phys_memory_alloc(0x200000, // size
+					      0x200000, // alignment
+					      0x100000, 0, // min/max address
+					      PHYS_MEMORY_ALLOCATED, // type
+					      PHYS_ALLOC_CANFAIL, // flags
+					      &phys_addr);
+	}
+
+	if(!allocated &&
+	   !phys_memory_alloc(count * PAGE_SIZE, // size
+			      0x1000, // alignment
+			      0x100000, 0, // min/max address
+			      PHYS_MEMORY_ALLOCATED, // type
+			      (count > 1) ? PHYS_ALLOC_CANFAIL : 0, // flags
+			      &phys_addr)) {
+		// No free range is large enough, split the run in two.
+		size_t half = count / 2;
+		load_run(loader, mmu, virtual, info, half);
+		load_run(loader, mmu, virtual + half * PAGE_SIZE, info + half, count - half);
+		return;
+	}
+
+	mmu_map(mmu, virtual, phys_addr, count * PAGE_SIZE);
+
+	// Write block numbers to the page info structs. Compressed pages share
+	// their group's block and cannot be written back to it in place, so
+	// they are left uncached with no block, like a newly allocated page.
+	for(size_t i = 0; i < count; i++) {
+		phys_ptr_t page = phys_addr + i * PAGE_SIZE;
+		if(info[i] & BLOCK_MAP_COMPRESSED) {
+			set_page_info_bin(mmu, page, fixnum(0));
+			set_page_info_flags(mmu, page, fixnum((virtual + i * PAGE_SIZE) & ~0xFFF));
+		} else {
+			set_page_info_bin(mmu, page, fixnum(info[i] >> BLOCK_MAP_ID_SHIFT));
+			set_page_info_flags(mmu, page, fixnum((virtual + i * PAGE_SIZE) & ~0xFFF) | fixnum(PAGE_FLAG_CACHE));
+		}
+	}
+
+	for(size_t i = 0; i < count; ) {
+		size_t n = 1;
+		if(info[i] & BLOCK_MAP_ZERO_FILL) {
+			while(i + n < count && (info[i + n] & BLOCK_MAP_ZERO_FILL)) {
+				n++;
+			}
+			zero_pages((void *)P2V(phys_addr + i * PAGE_SIZE), n * PAGE_SIZE);
+		} else if(info[i] & BLOCK_MAP_COMPRESSED) {
+			queue_segment(loader, info[i] >> BLOCK_MAP_ID_SHIFT, phys_addr + i * PAGE_SIZE, 0,
+				      (info[i] & BLOCK_MAP_GROUP_INDEX_MASK) >> BLOCK_MAP_GROUP_INDEX_SHIFT);
+		} else {
+			uint64_t block = info[i] >> BLOCK_MAP_ID_SHIFT;
+			while(i + n < count && !(info[i + n] & (BLOCK_MAP_ZERO_FILL | BLOCK_MAP_COMPRESSED)) &&
+			      (info[i + n] >> BLOCK_MAP_ID_SHIFT) == block + n) {
+				n++;
+			}
+			queue_segment(loader, block, phys_addr + i * PAGE_SIZE, n, 0);
+		}
+		i += n;
+	}
+}
+
+static void sift_segment(load_segment_t *segments, size_t root, size_t n) {
+	while(root * 2 + 1 < n) {
+		size_t child = root * 2 + 1;
+		if(child + 1 < n && segments[child + 1].block > segments[child].block) {
+			child++;
+		}
+		if(segments[root].block >= segments[child].block) {
+			return;
+		}
+		load_segment_t tmp = segments[root];
+		segments[root] = segments[child];
+		segments[child] = tmp;
+		root = child;
+	}
+}
+
+// Heap sort the queued segments by image block.
+static void sort_segments(load_segment_t *segments, size_t n) {
+	for(size_t i = n / 2; i > 0; i--) {
+		sift_segment(segments, i - 1, n);
+	}
+	for(size_t i = n; i > 1; i--) {
+		load_segment_t tmp = segments[0];
+		segments[0] = segments[i - 1];
+		segments[i - 1] = tmp;
+		sift_segment(segments, 0, i - 1);
+	}
+}
+
+// Read and decompress a compressed group into the group output buffer,
+// unless it is already there. Returns the number of disk transfers.
+static size_t read_compressed_group(mezzanine_loader_t *loader, uint64_t block) {
+	if(loader->group_out && loader->group_block == block) {
+		return 0;
+	}
+
+	if(!loader->group_out) {
+		// Heap is fixed-size, use pages directly.
+		phys_ptr_t phys_addr;
+		phys_memory_alloc(COMPRESSED_GROUP_MAX_BLOCKS * 0x1000 + COMPRESSED_GROUP_MAX_SIZE, // size
+				  0x1000, // alignment
+				  0, 0, // min/max address
+				  PHYS_MEMORY_INTERNAL, // type
+				  0, // flags
+				  &phys_addr);
+		loader->group_in = (void *)P2V(phys_addr);
+		loader->group_out = (void *)P2V(phys_addr + COMPRESSED_GROUP_MAX_BLOCKS * 0x1000);
+	}
+
+	// Read the first block to find out how big the group is, then the rest.
+	size_t transfers = 1;
+	if(!disk_read(loader->disk, loader->group_in, 0x1000, block * 0x1000)) {
+		boot_error("Could not read compressed group %" PRIu64, block);
+	}
+	mezzanine_compressed_group_t *header = loader->group_in;
+	size_t blocks = (sizeof(*header) + header->compressed_size + 0xFFF) / 0x1000;
+	if(header->compressed_size > (COMPRESSED_GROUP_MAX_BLOCKS * 0x1000 - sizeof(*header)) ||
+	   header->uncompressed_size > COMPRESSED_GROUP_MAX_SIZE ||
+	   header->uncompressed_size % PAGE_SIZE) {
+		boot_error("Compressed group %" PRIu64 " is invalid", block);
+	}
+	if(blocks > 1) {
+		if(!disk_read(loader->disk, loader->group_in + 0x1000, (blocks - 1) * 0x1000, (block + 1) * 0x1000)) {
+			boot_error("Could not read compressed group %" PRIu64, block);
+		}
+		transfers++;
+	}
+
+	size_t size;
+	if(!lz4_decompress(loader->group_in + sizeof(*header), header->compressed_size,
+			   loader->group_out, COMPRESSED_GROUP_MAX_SIZE, &size) ||
+	   size != header->uncompressed_size) {
+		boot_error("Compressed group %" PRIu64 " is corrupt", block);
+	}
+
+	loader->group_block = block;
+	loader->group_size = size;
+	return transfers;
+}
+
+// Issue all queued reads in disk order.
+// Blocks in the image are laid out by the GC and writeback order rather
+// than by virtual address, so reading in virtual address order seeks all
+// over the disk. Segments that continue each other both on disk and in
+// memory are merged into a single transfer.
+static void read_segments(mezzanine_loader_t *loader) {
+	load_segment_t *segments = loader->segments;
+	size_t transfers = 0;
+
+	sort_segments(segments, loader->n_segments);
+
+	for(size_t i = 0; i < loader->n_segments; ) {
+		if(segments[i].count == 0) {
+			// Pages from the same group are adjacent after sorting, so each
+			// group is only decompressed once.
+			transfers += read_compressed_group(loader, segments[i].block);
+			if((segments[i].index + 1) * PAGE_SIZE > loader->group_size) {
+				boot_error("Page %" PRIu32 " is beyond the end of compressed group %" PRIu64,
+					   segments[i].index, segments[i].block);
+			}
+			memcpy((void *)P2V(segments[i].phys), loader->group_out + segments[i].index * PAGE_SIZE, PAGE_SIZE);
+			i++;
+			continue;
+		}
+
+		uint64_t block = segments[i].block;
+		phys_ptr_t phys = segments[i].phys;
+		uint64_t count = segments[i].count;
+		size_t j = i + 1;
+		while(j < loader->n_segments &&
+		      segments[j].count != 0 &&
+		      segments[j].block == block + count &&
+		      segments[j].phys == phys + count * PAGE_SIZE) {
+			count += segments[j].count;
+			j++;
+		}
 		if(!disk_read(loader->disk,
-			      (void *)P2V(phys_addr),
-			      0x1000,
-			      (info >> BLOCK_MAP_ID_SHIFT) * 0x1000)) {
-			boot_error("Could not read block %" PRIu64 " for virtual address %" PRIx64, info, virtual);
+			      (void *)P2V(phys),
+			      count * 0x1000,
+			      block * 0x1000)) {
+			boot_error("Could not read blocks %" PRIu64 "-%" PRIu64 " to %" PRIxPHYS,
+				   block, block + count - 1, phys);
+		}
+		transfers++;
+		i = j;
+	}
+
+	dprintf("mezzanine: read %zu segments with %zu disk transfers\n",
+		loader->n_segments, transfers);
+}
+
+// Load all present pages in an extent.
+// The block map is walked one level 1 table (2MB of virtual address space)
+// at a time, loading each run of present pages together. Reads are only
+// queued, read_segments() must be called once all extents are loaded.
+static void load_extent(mezzanine_loader_t *loader, mmu_context_t *mmu, uint64_t base, uint64_t size) {
+	uint64_t virtual = base;
+	uint64_t end = base + size;
+	size_t pages = 0, runs = 0;
+
+	while(virtual < end) {
+		uint64_t table_end = MIN((virtual & ~0x1FFFFFull) + 0x200000, end);
+		uint64_t *bml1 = read_block_map_l1(loader, virtual);
+		if(!bml1) {
+			virtual = table_end;
+			continue;
+		}
+
+		while(virtual < table_end) {
+			const uint64_t *info = &bml1[(virtual >> 12) & 0x1FF];
+			if((info[0] & BLOCK_MAP_PRESENT) == 0) {
+				virtual += PAGE_SIZE;
+				continue;
+			}
+
+			size_t count = 1;
+			while(virtual + count * PAGE_SIZE < table_end &&
+			      (info[count] & BLOCK_MAP_PRESENT)) {
+				count++;
+			}
+
+			load_run(loader, mmu, virtual, info, count);
+			pages += count;
+			runs++;
+			virtual += count * PAGE_SIZE;
+		}
+	}
+
+	dprintf("mezzanine: loaded %zu pages in %zu runs\n", pages, runs);
+}
+
+// Map and allocate all extents in the image, queueing reads of their
+// contents. read_segments() must be called afterwards.
+static void load_extents(mezzanine_loader_t *loader, mmu_context_t *mmu) {
+	loader->segments = NULL;
+	loader->n_segments = 0;
+	loader->max_segments = 0;
+	loader->group_in = NULL;
+	loader->group_out = NULL;
+	for(uint32_t i = 0; i < loader->header.n_extents; ++i) {
+		// Each extent must be 4k (page) aligned in memory.
+		dprintf("mezzanine: extent % 2" PRIu32 " %016" PRIx64 " %08" PRIx64 " %04" PRIx64 "\n",
+			i, loader->header.extents[i].virtual_base,
+			loader->header.extents[i].size, loader->header.extents[i].flags);
+		if(loader->header.extents[i].virtual_base % PAGE_SIZE ||
+		   loader->header.extents[i].size % PAGE_SIZE) {
+			boot_error("Extent %" PRIu32 " is misaligned", i);
+		}
+
+		if(loader->header.extents[i].flags & EXTENT_FLAG_ALIAS) {
+			mmu_alias(mmu, loader->header.extents[i].virtual_base, loader->header.extents[i].extra, loader->header.extents[i].size);
+			continue;
+		}
+
+		// Load each run of pages in the region.
+		load_extent(loader, mmu, loader->header.extents[i].virtual_base, loader->header.extents[i].size);
+	}
+}
+
+// Build the buddy allocator from all memory that is free once the loader's
+// internal memory has been reclaimed.
+static void build_buddy_allocator(mmu_context_t *mmu, mezzanine_boot_information_t *boot_info, uint64_t nil) {
+	// Initialize buddy bins.
+	for(int i = 0; i < mezzanine_n_buddy_bins_32_bit; ++i) {
+		boot_info->buddy_bin_32[i].first_page = nil;
+		boot_info->buddy_bin_32[i].count = fixnum(0);
+	}
+	for(int i = 0; i < mezzanine_n_buddy_bins_64_bit; ++i) {
+		boot_info->buddy_bin_64[i].first_page = nil;
+		boot_info->buddy_bin_64[i].count = fixnum(0);
+	}
+
+	// For each free kboot memory region, add pages to the buddy allocator.
+	// Also avoid any memory below 1MB, it's weird.
+	// https://lkml.org/lkml/2013/11/11/614
+	// The range list is sorted and adjacent free ranges are merged, so each
+	// range can be split into buddy blocks independently.
+	phys_ptr_t tails_32[mezzanine_n_buddy_bins_32_bit];
+	phys_ptr_t tails_64[mezzanine_n_buddy_bins_64_bit];
+	LIST_FOREACH(&memory_ranges, iter) {
+		memory_range_t *range = list_entry(iter, memory_range_t, header);
+		if(range->type != PHYS_MEMORY_FREE) {
+			continue;
+		}
+
+		// Pages up to and including the one at 1MB are skipped.
+		phys_ptr_t start = MAX(range->start, 1024 * 1024 + PAGE_SIZE);
+		phys_ptr_t end = range->start + range->size;
+		if(start < end) {
+			buddy_free_range(mmu, boot_info, nil, tails_32, tails_64, start, end);
 		}
 	}
 }
@@ -712,29 +1161,13 @@ static __noreturn void mezzanine_loader_load(void) {
 	mezzanine_boot_information_t *boot_info = (mezzanine_boot_information_t *)P2V(boot_info_page);
 	memset(boot_info, 0, PAGE_SIZE);
 
+	trace_phase(TRACE_PHASE_MMU);
 	generate_memory_map(mmu, boot_info);
 
-	for(uint32_t i = 0; i < loader->header.n_extents; ++i) {
-		// Each extent must be 4k (page) aligned in memory.
-		dprintf("mezzanine: extent % 2" PRIu32 " %016" PRIx64 " %08" PRIx64 " %04" PRIx64 "\n",
-			i, loader->header.extents[i].virtual_base,
-			loader->header.extents[i].size, loader->header.extents[i].flags);
-		if(loader->header.extents[i].virtual_base % PAGE_SIZE ||
-		   loader->header.extents[i].size % PAGE_SIZE) {
-			boot_error("Extent %" PRIu32 " is misaligned", i);
-		}
+	load_extents(loader, mmu);
+	read_segments(loader);
 
-		if(loader->header.extents[i].flags & EXTENT_FLAG_ALIAS) {
-			mmu_alias(mmu, loader->header.extents[i].virtual_base, loader->header.extents[i].extra, loader->header.extents[i].size);
-			continue;
-		}
-
-		// Load each page in the region.
-		// TODO: Use 2M pages.
-		for(uint64_t offset = 0; offset < loader->header.extents[i].size; offset += PAGE_SIZE) {
-			load_page(loader, mmu, loader->header.extents[i].virtual_base + offset);
-		}
-	}
+	trace_phase(TRACE_PHASE_MODULES);
 
 	// When there are modules, allocate the module info pages.
 	if(loader->modules.list->count) {
@@ -767,7 +1200,7 @@ static __noreturn void mezzanine_loader_load(void) {
 
 			char *tmp = strrchr(list->values[i].string, '/');
 			char *name = (tmp) ? tmp + 1 : list->values[i].string;
-			load_module(current, handle, name);
+			load_module(current, handle, name, list->values[i].string);
 			file_close(handle);
 
 			current += (24 + strlen(name) + 15) & ~15;
@@ -783,16 +1216,6 @@ static __noreturn void mezzanine_loader_load(void) {
 
 	set_video_mode(boot_info);
 
-	// Initialize buddy bins.
-	for(int i = 0; i < mezzanine_n_buddy_bins_32_bit; ++i) {
-		boot_info->buddy_bin_32[i].first_page = loader->header.nil;
-		boot_info->buddy_bin_32[i].count = fixnum(0);
-	}
-	for(int i = 0; i < mezzanine_n_buddy_bins_64_bit; ++i) {
-		boot_info->buddy_bin_64[i].first_page = loader->header.nil;
-		boot_info->buddy_bin_64[i].count = fixnum(0);
-	}
-
 	// Generate the page tables used for transitioning from identity mapping
 	// to the final page tables.
 	// The loader must be identity mapped, and mapped in the physical region.
@@ -805,23 +1228,15 @@ static __noreturn void mezzanine_loader_load(void) {
 	/* Reclaim all memory used internally. */
 	memory_finalize();
 
-	// For each free kboot memory region, add pages to the buddy allocator.
-	// Also avoid any memory below 1MB, it's weird.
-	// https://lkml.org/lkml/2013/11/11/614
-	// fixme: do this in a less stupid way (whole power-of-two chunks at a time, not single pages).
-	LIST_FOREACH(&memory_ranges, iter) {
-		memory_range_t *range = list_entry(iter, memory_range_t, header);
-
-		for(phys_ptr_t i = 0; i < range->size; i += PAGE_SIZE) {
-			if(range->type == PHYS_MEMORY_FREE && range->start + i > 1024 * 1024) {
-				buddy_free_page(mmu, boot_info, loader->header.nil, range->start + i);
-			}
-		}
-	}
-
+	build_buddy_allocator(mmu, boot_info, loader->header.nil);
 	dump_buddy_allocator(mmu, boot_info, loader->header.nil);
 
 	dprintf("mezzanine: Starting system...\n");
+	trace_phase(TRACE_PHASE_HANDOFF);
+	boot_info->timing_frequency = trace_frequency();
+	for(int i = 0; i < mezzanine_n_timing_phases; ++i) {
+		boot_info->timing[i] = trace_timestamp(i);
+	}
 	mezzanine_arch_enter(transition->cr3,
 			     mmu->cr3,
 			     loader->header.entry_fref,
@@ -863,6 +1278,10 @@ static bool config_cmd_mezzanine(value_list_t *args) {
 	STATIC_ASSERT(offsetof(mezzanine_boot_information_t, module_info_base) == 808);
 	STATIC_ASSERT(offsetof(mezzanine_boot_information_t, n_memory_map_entries) == 824);
 	STATIC_ASSERT(offsetof(mezzanine_boot_information_t, memory_map) == 832);
+	STATIC_ASSERT(offsetof(mezzanine_boot_information_t, timing_frequency) == 2880);
+	STATIC_ASSERT(offsetof(mezzanine_boot_information_t, timing) == 2888);
+	STATIC_ASSERT(mezzanine_n_timing_phases == TRACE_PHASE_COUNT);
+	STATIC_ASSERT(sizeof(mezzanine_boot_information_t) <= PAGE_SIZE);
 	STATIC_ASSERT(offsetof(mezzanine_page_info_t, flags) == 0);
 	STATIC_ASSERT(offsetof(mezzanine_page_info_t, bin) == 8);
 	STATIC_ASSERT(offsetof(mezzanine_page_info_t, next) == 16);
@@ -890,7 +1309,10 @@ static bool config_cmd_mezzanine(value_list_t *args) {
 	}
 
 	data = kmalloc(sizeof *data);
-	data->block_cache = NULL;
+	memset(data->block_cache, 0, sizeof(data->block_cache));
+	list_init(&data->block_cache_lru);
+	data->block_cache_count = 0;
+	data->last_bml2_block = 0;
 	data->device_name = kstrdup(args->values[0].string);
 	data->disk = (disk_t *)device;
 
@@ -28,6 +28,7 @@
 #include <loader.h>
 #include <memory.h>
 #include <menu.h>
+#include <trace.h>
 
 /** Maximum number of pre-boot hooks. */
 #define PREBOOT_HOOKS_MAX	8
@@ -58,11 +59,13 @@ void loader_main(void) {
 		boot_error("Could not find boot filesystem");
 
 	/* Load the configuration file. */
+	trace_phase(TRACE_PHASE_CONFIG);
 	config_init();
 
 	/* Display the menu interface if enabled. If not, the root environment
 	 * should have the OS loaded. */
 	#if CONFIG_KBOOT_UI
+	trace_phase(TRACE_PHASE_MENU);
 	current_environ = menu_display();
 	#endif
 
@@ -73,5 +76,6 @@ void loader_main(void) {
 		boot_error("No operating system loaded");
 	}
 
+	trace_phase(TRACE_PHASE_KERNEL);
 	current_environ->loader->load();
 }
@@ -32,10 +32,15 @@ typedef struct heap_chunk {
 	list_t header;			/**< Link to chunk list. */
 	size_t size;			/**< Size of chunk including struct. */
 	bool allocated;			/**< Whether the chunk is allocated. */
-} heap_chunk_t;
+	#if CONFIG_DEBUG
+	void *caller;			/**< Address the chunk was allocated from. */
+	#endif
+} __aligned(8) heap_chunk_t;
 
-/** Size of the heap (128KB). */
-#define HEAP_SIZE		131072
+/** Size of the heap (128KB unless overridden by the architecture). */
+#ifndef HEAP_SIZE
+# define HEAP_SIZE		131072
+#endif
 
 /** Statically allocated heap. */
 static uint8_t heap[HEAP_SIZE] __aligned(PAGE_SIZE);
@@ -44,11 +49,30 @@ static LIST_DECLARE(heap_chunks);
 /** List of physical memory ranges. */
 LIST_DECLARE(memory_ranges);
 
+/** Memory usage statistics (free space information is calculated on demand). */
+static memory_stats_t stats = {
+	.heap_size = HEAP_SIZE,
+};
+
+#if CONFIG_DEBUG
+
+/** Number of callers to show in the heap usage dump. */
+#define HEAP_DUMP_CALLERS	8
+
+/** Structure used to total heap usage by caller. */
+typedef struct heap_caller {
+	void *caller;			/**< Address of caller. */
+	size_t size;			/**< Total size allocated. */
+	unsigned count;			/**< Number of allocations. */
+} heap_caller_t;
+
+#endif
+
 /** Allocate memory from the heap.
- * @note		An internal error will be raised if heap is full.
  * @param size		Size of allocation to make.
+ * @param caller	Address that the allocation was made from.
  * @return		Address of allocation. */
-void *kmalloc(size_t size) {
+static void *heap_alloc(size_t size, void *caller) {
 	heap_chunk_t *chunk = NULL, *new;
 	size_t total;
 
@@ -77,8 +101,10 @@ void *kmalloc(size_t size) {
 			}
 		}
 
-		if(!chunk)
+		if(!chunk) {
+			memory_stats_dump();
 			internal_error("Exhausted heap space (want %zu bytes)", size);
+		}
 	}
 
 	/* Resize the segment if it is too big. There must be space for a
@@ -93,9 +119,26 @@ void *kmalloc(size_t size) {
 	}
 
 	chunk->allocated = true;
+	#if CONFIG_DEBUG
+	chunk->caller = caller;
+	#endif
+
+	stats.heap_allocs++;
+	stats.heap_current += chunk->size;
+	if(stats.heap_current > stats.heap_peak)
+		stats.heap_peak = stats.heap_current;
+
 	return ((char *)chunk + sizeof(heap_chunk_t));
 }
 
+/** Allocate memory from the heap.
+ * @note		An internal error will be raised if heap is full.
+ * @param size		Size of allocation to make.
+ * @return		Address of allocation. */
+void *kmalloc(size_t size) {
+	return heap_alloc(size, __builtin_return_address(0));
+}
+
 /** Resize a memory allocation.
  * @param addr		Address of old allocation.
  * @param size		New size of allocation.
@@ -108,7 +151,7 @@ void *krealloc(void *addr, size_t size) {
 		kfree(addr);
 		return NULL;
 	} else {
-		new = kmalloc(size);
+		new = heap_alloc(size, __builtin_return_address(0));
 		if(addr) {
 			chunk = (heap_chunk_t *)((char *)addr - sizeof(heap_chunk_t));
 			memcpy(new, addr, MIN(chunk->size - sizeof(heap_chunk_t), size));
@@ -132,6 +175,9 @@ void kfree(void *addr) {
 		internal_error("Double free on address %p", addr);
 	chunk->allocated = false;
 
+	stats.heap_frees++;
+	stats.heap_current -= chunk->size;
+
 	/* Coalesce adjacent free segments. */
 	if(chunk->header.next != &heap_chunks) {
 		adj = list_entry(chunk->header.next, heap_chunk_t, header);
@@ -309,14 +355,15 @@ void phys_memory_protect(phys_ptr_t start, phys_size_t size) {
  * @param range		Range to check.
  * @param size		Size of the allocation.
  * @param align		Alignment of the allocation.
+ * @param offset	Offset of the allocation from an aligned boundary.
  * @param min_addr	Minimum address for the start of the allocated range.
  * @param max_addr	Maximum address of the end of the allocated range.
  * @param flags		Behaviour flags.
  * @param physp		Where to store address for allocation.
  * @return		Whether the range can satisfy the allocation. */
 static bool is_suitable_range(memory_range_t *range, phys_size_t size,
-	phys_size_t align, phys_ptr_t min_addr, phys_ptr_t max_addr,
-	unsigned flags, phys_ptr_t *physp)
+	phys_size_t align, phys_size_t offset, phys_ptr_t min_addr,
+	phys_ptr_t max_addr, unsigned flags, phys_ptr_t *physp)
 {
 	phys_ptr_t start, match_start, match_end;
 
@@ -331,11 +378,17 @@ static bool is_suitable_range(memory_range_t *range, phys_size_t size,
 
 	/* Align the base address and check that the range fits. */
 	if(flags & PHYS_ALLOC_HIGH) {
-		start = ROUND_DOWN((match_end - size) + 1, align);
+		start = (match_end - size) + 1;
+		if(start < offset)
+			return false;
+
+		start = ROUND_DOWN(start - offset, align) + offset;
 		if(start < match_start)
 			return false;
 	} else {
-		start = ROUND_UP(match_start, align);
+		start = (match_start < offset)
+			? offset
+			: ROUND_UP(match_start - offset, align) + offset;
 		if((start + size - 1) > match_end)
 			return false;
 	}
@@ -366,6 +419,37 @@ static bool is_suitable_range(memory_range_t *range, phys_size_t size,
 bool phys_memory_alloc(phys_size_t size, phys_size_t align, phys_ptr_t min_addr,
 	phys_ptr_t max_addr, unsigned type, unsigned flags,
 	phys_ptr_t *physp)
+{
+	return phys_memory_alloc_offset(size, align, 0, min_addr, max_addr, type,
+		flags, physp);
+}
+
+/**
+ * Allocate a range of physical memory at an offset from an aligned boundary.
+ *
+ * Allocates a range of physical memory in the same way as phys_memory_alloc(),
+ * except that the start address will be the specified offset from a multiple
+ * of the alignment rather than exactly aligned. This is used to give physical
+ * memory the same offset into a large page as the virtual address it will be
+ * mapped at, so that it can be mapped using large pages.
+ *
+ * @param size		Size of the range (multiple of PAGE_SIZE).
+ * @param align		Alignment of the range (power of 2, at least PAGE_SIZE).
+ * @param offset	Offset from an aligned boundary (multiple of
+ *			PAGE_SIZE, less than the alignment).
+ * @param min_addr	Minimum address for the start of the allocated range.
+ * @param max_addr	Maximum address of the end of the allocated range.
+ * @param type		Type to give the allocated range (must not be
+ *			PHYS_MEMORY_FREE).
+ * @param flags		Behaviour flags.
+ * @param physp		Where to store address of allocation.
+ *
+ * @return		Whether successfully allocated (always true unless
+ *			PHYS_ALLOC_CANFAIL specified).
+ */
+bool phys_memory_alloc_offset(phys_size_t size, phys_size_t align, phys_size_t offset,
+	phys_ptr_t min_addr, phys_ptr_t max_addr, unsigned type, unsigned flags,
+	phys_ptr_t *physp)
 {
 	memory_range_t *range;
 	phys_ptr_t start;
@@ -375,6 +459,7 @@ bool phys_memory_alloc(phys_size_t size, phys_size_t align, phys_ptr_t min_addr,
 
 	assert(!(size % PAGE_SIZE));
 	assert(!(align % PAGE_SIZE));
+	assert(!(offset % PAGE_SIZE) && offset < align);
 	assert(type >= PHYS_MEMORY_ALLOCATED);
 
 	/* Ensure that all addresses allocated are accessible to us. */
@@ -388,7 +473,7 @@ bool phys_memory_alloc(phys_size_t size, phys_size_t align, phys_ptr_t min_addr,
 	if(flags & PHYS_ALLOC_HIGH) {
 		LIST_FOREACH_REVERSE(&memory_ranges, iter) {
 			range = list_entry(iter, memory_range_t, header);
-			if(is_suitable_range(range, size, align, min_addr, max_addr, flags, &start))
+			if(is_suitable_range(range, size, align, offset, min_addr, max_addr, flags, &start))
 				break;
 
 			range = NULL;
@@ -396,7 +481,7 @@ bool phys_memory_alloc(phys_size_t size, phys_size_t align, phys_ptr_t min_addr,
 	} else {
 		LIST_FOREACH(&memory_ranges, iter) {
 			range = list_entry(iter, memory_range_t, header);
-			if(is_suitable_range(range, size, align, min_addr, max_addr, flags, &start))
+			if(is_suitable_range(range, size, align, offset, min_addr, max_addr, flags, &start))
 				break;
 
 			range = NULL;
@@ -413,6 +498,9 @@ bool phys_memory_alloc(phys_size_t size, phys_size_t align, phys_ptr_t min_addr,
 	/* Insert a new range over the top of the allocation. */
 	memory_range_insert(start, size, type);
 
+	stats.phys_allocs++;
+	stats.phys_allocated += size;
+
 	*physp = start;
 	return true;
 }
@@ -455,6 +543,124 @@ static void phys_memory_dump(void) {
 	}
 }
 
+/** Get memory usage statistics.
+ * @param statsp	Where to store statistics. */
+void memory_stats(memory_stats_t *statsp) {
+	heap_chunk_t *chunk;
+	memory_range_t *range;
+	size_t free_size = 0;
+
+	*statsp = stats;
+	statsp->heap_largest = 0;
+	statsp->heap_free_chunks = 0;
+	statsp->phys_internal = 0;
+	statsp->phys_free = 0;
+
+	LIST_FOREACH(&heap_chunks, iter) {
+		chunk = list_entry(iter, heap_chunk_t, header);
+		if(chunk->allocated)
+			continue;
+
+		free_size += chunk->size;
+		statsp->heap_free_chunks++;
+		if(chunk->size > statsp->heap_largest)
+			statsp->heap_largest = chunk->size;
+	}
+
+	/* The heap is only set up on the first allocation. */
+	if(list_empty(&heap_chunks)) {
+		free_size = statsp->heap_largest = HEAP_SIZE;
+		statsp->heap_free_chunks = 1;
+	}
+
+	/* Fragmentation is the proportion of free space that is not part of
+	 * the largest free block. */
+	statsp->heap_fragmentation = (free_size)
+		? 100 - ((statsp->heap_largest * 100) / free_size)
+		: 0;
+
+	LIST_FOREACH(&memory_ranges, iter) {
+		range = list_entry(iter, memory_range_t, header);
+		if(range->type == PHYS_MEMORY_INTERNAL) {
+			statsp->phys_internal += range->size;
+		} else if(range->type == PHYS_MEMORY_FREE) {
+			statsp->phys_free += range->size;
+		}
+	}
+}
+
+#if CONFIG_DEBUG
+
+/** Print the callers holding the most heap space. */
+static void heap_dump_callers(void) {
+	heap_caller_t callers[HEAP_DUMP_CALLERS];
+	size_t count = 0, i, j;
+	heap_chunk_t *chunk;
+
+	LIST_FOREACH(&heap_chunks, iter) {
+		chunk = list_entry(iter, heap_chunk_t, header);
+		if(!chunk->allocated)
+			continue;
+
+		for(i = 0; i < count; i++) {
+			if(callers[i].caller == chunk->caller)
+				break;
+		}
+
+		if(i == count) {
+			if(count < ARRAY_SIZE(callers)) {
+				count++;
+			} else {
+				/* Replace the smallest entry if this chunk is
+				 * larger. This is approximate, but is good
+				 * enough to find the worst offenders. */
+				for(i = 0, j = 1; j < count; j++) {
+					if(callers[j].size < callers[i].size)
+						i = j;
+				}
+
+				if(callers[i].size >= chunk->size)
+					continue;
+			}
+
+			callers[i].caller = chunk->caller;
+			callers[i].size = 0;
+			callers[i].count = 0;
+		}
+
+		callers[i].size += chunk->size;
+		callers[i].count++;
+	}
+
+	for(i = 0; i < count; i++) {
+		dprintf(" %p: %zu bytes in %u allocations\n", callers[i].caller,
+			callers[i].size, callers[i].count);
+	}
+}
+
+#endif
+
+/** Print memory usage statistics to the debug log. */
+void memory_stats_dump(void) {
+	memory_stats_t current;
+
+	memory_stats(&current);
+
+	dprintf("memory: heap usage %zu/%zu bytes (peak: %zu, allocs: %u, frees: %u)\n",
+		current.heap_current, current.heap_size, current.heap_peak,
+		current.heap_allocs, current.heap_frees);
+	dprintf("memory: heap largest free %zu bytes (free blocks: %zu, fragmentation: %u%%)\n",
+		current.heap_largest, current.heap_free_chunks, current.heap_fragmentation);
+	dprintf("memory: physical allocated 0x%" PRIxPHYS " bytes (allocs: %u, internal: 0x%"
+		PRIxPHYS ", free: 0x%" PRIxPHYS ")\n", current.phys_allocated,
+		current.phys_allocs, current.phys_internal, current.phys_free);
+
+	#if CONFIG_DEBUG
+	dprintf("memory: largest heap users:\n");
+	heap_dump_callers();
+	#endif
+}
+
 /** Initialise the memory manager.
  * @note		Platform code is expected to add all memory ranges
  *			before calling this function. */
@@ -487,4 +693,5 @@ void memory_finalize(void) {
 	/* Dump the memory map to the debug console. */
 	dprintf("memory: final memory map:\n");
 	phys_memory_dump();
+	memory_stats_dump();
 }
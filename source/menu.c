@@ -23,6 +23,7 @@
 #include <lib/utility.h>
 
 #include <assert.h>
+#include <fs.h>
 #include <loader.h>
 #include <memory.h>
 #include <menu.h>
@@ -158,6 +159,9 @@ static input_result_t menu_entry_configure(ui_entry_t *_entry) {
 static input_result_t menu_entry_debug(ui_entry_t *_entry) {
 	ui_window_t *window;
 
+	/* Log the current memory usage so that it can be seen in the window. */
+	memory_stats_dump();
+
 	/* Create the debug log window. */
 	window = ui_textview_create("Debug Log", debug_log, DEBUG_LOG_SIZE,
 		debug_log_start, debug_log_length);
@@ -216,6 +220,33 @@ static bool menu_entry_configurable(menu_entry_t *entry) {
 	return ret;
 }
 
+#if CONFIG_KBOOT_PRELOAD
+
+/** Entry that has been preloaded. */
+static menu_entry_t *preloaded_menu_entry = NULL;
+
+/** Preload the selected entry while the menu is waiting to time out.
+ * @return		Whether there is more to preload. */
+static bool menu_preload(void) {
+	menu_entry_t *entry = selected_menu_entry;
+	environ_t *prev;
+	bool ret;
+
+	if(!entry->env->loader || !entry->env->loader->preload)
+		return false;
+
+	preloaded_menu_entry = entry;
+
+	prev = current_environ;
+	current_environ = entry->env;
+	ret = entry->env->loader->preload();
+	current_environ = prev;
+
+	return ret;
+}
+
+#endif
+
 /** Display the menu interface.
  * @return		Environment for the entry to boot. */
 environ_t *menu_display(void) {
@@ -252,10 +283,23 @@ environ_t *menu_display(void) {
 		if((value = environ_lookup(root_environ, "timeout")) && value->type == VALUE_TYPE_INTEGER)
 			timeout = value->integer;
 
-		/* Display it. The selected entry pointer will be updated. */
+		/* Display it. The selected entry pointer will be updated. The
+		 * default entry is preloaded while waiting for the timeout, as
+		 * that is usually the one that gets booted. */
+		#if CONFIG_KBOOT_PRELOAD
+		ui_window_display_idle(window, timeout, menu_preload);
+		#else
 		ui_window_display(window, timeout);
+		#endif
 	}
 
+	#if CONFIG_KBOOT_PRELOAD
+	/* If a different entry was preloaded, free what was preloaded for it
+	 * so that it does not take up memory needed by this one. */
+	if(preloaded_menu_entry && preloaded_menu_entry != selected_menu_entry)
+		file_preload_release_all();
+	#endif
+
 	dprintf("loader: booting menu entry '%s'\n", selected_menu_entry->name);
 	return selected_menu_entry->env;
 }
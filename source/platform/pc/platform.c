@@ -35,6 +35,7 @@
 #include <memory.h>
 #include <tar.h>
 #include <time.h>
+#include <trace.h>
 
 /** Main function of the PC loader. */
 void platform_init(void) {
@@ -43,9 +44,12 @@ void platform_init(void) {
 
 	/* Initialize the architecture. */
 	arch_init();
+	trace_phase(TRACE_PHASE_ENTRY);
 
 	/* Initialize hardware. */
+	trace_phase(TRACE_PHASE_MEMORY);
 	memory_probe();
+	trace_phase(TRACE_PHASE_DISK);
 	disk_init();
 	vbe_init();
 
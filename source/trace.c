@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Boot phase tracing.
+ *
+ * Records a timestamp at the start of each phase of the boot process. The
+ * timestamps are passed on to the kernel by loaders that support it. If
+ * CONFIG_KBOOT_TRACE is enabled, a marker line is also printed to the debug
+ * console for each phase, in the following format:
+ *
+ *   trace: <phase> <timestamp> <frequency>
+ *
+ * The timestamp is a raw cycle counter value and the frequency is the number
+ * of counter ticks per second. These are parsed from the serial log by the
+ * boot time benchmark.
+ */
+
+#include <loader.h>
+#include <time.h>
+#include <trace.h>
+
+/** Timestamps recorded for each phase (0 if not reached). */
+static uint64_t trace_timestamps[TRACE_PHASE_COUNT];
+
+#if CONFIG_KBOOT_TRACE
+
+/** Names of the boot phases. */
+static const char *trace_phase_names[] = {
+	[TRACE_PHASE_ENTRY] = "entry",
+	[TRACE_PHASE_MEMORY] = "memory",
+	[TRACE_PHASE_DISK] = "disk",
+	[TRACE_PHASE_CONFIG] = "config",
+	[TRACE_PHASE_MENU] = "menu",
+	[TRACE_PHASE_KERNEL] = "kernel",
+	[TRACE_PHASE_MMU] = "mmu",
+	[TRACE_PHASE_MODULES] = "modules",
+	[TRACE_PHASE_HANDOFF] = "handoff",
+};
+
+#endif
+
+/** Record the start of a boot phase.
+ * @param phase		Phase that is starting. */
+void trace_phase(trace_phase_t phase) {
+	uint64_t stamp = arch_timestamp();
+
+	trace_timestamps[phase] = stamp;
+
+	#if CONFIG_KBOOT_TRACE
+	dprintf("trace: %s %" PRIu64 " %" PRIu64 "\n", trace_phase_names[phase], stamp,
+		arch_timestamp_frequency());
+	#endif
+}
+
+/** Get the timestamp recorded for a boot phase.
+ * @param phase		Phase to get timestamp for.
+ * @return		Timestamp recorded at the start of the phase, or 0 if
+ *			the phase has not been reached. */
+uint64_t trace_timestamp(trace_phase_t phase) {
+	return trace_timestamps[phase];
+}
+
+/** Get the frequency of the timestamps.
+ * @return		Number of timestamp ticks per second. */
+uint64_t trace_frequency(void) {
+	return arch_timestamp_frequency();
+}
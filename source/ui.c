@@ -240,11 +240,30 @@ static void ui_window_update(ui_window_t *window, int seconds) {
 	}
 }
 
-/** Display a window.
+#if CONFIG_KBOOT_PRELOAD
+
+/** Do a piece of work while waiting for a window to time out.
+ * @param idlep		Pointer to idle function, set to NULL once there is no
+ *			more work to do.
+ * @return		Time taken in microseconds. */
+static timeout_t do_idle_work(ui_idle_func_t *idlep) {
+	uint64_t start = arch_timestamp(), freq = arch_timestamp_frequency();
+
+	if(!(*idlep)())
+		*idlep = NULL;
+
+	return (freq >= 1000000) ? (arch_timestamp() - start) / (freq / 1000000) : 0;
+}
+
+#endif
+
+/** Display a window and handle input.
  * @param window	Window to display.
  * @param timeout	Seconds to wait before closing the window if no input.
- *			If 0, the window will not time out. */
-void ui_window_display(ui_window_t *window, int timeout) {
+ *			If 0, the window will not time out.
+ * @param idle		Function to call while waiting to time out (can be
+ *			NULL). */
+static void window_display(ui_window_t *window, int timeout, ui_idle_func_t idle) {
 	timeout_t us = timeout * 1000000;
 	input_result_t result;
 	uint16_t key;
@@ -257,8 +276,18 @@ void ui_window_display(ui_window_t *window, int timeout) {
 				timeout = 0;
 				continue;
 			} else {
+				#if CONFIG_KBOOT_PRELOAD
+				if(idle) {
+					us -= MAX(do_idle_work(&idle), 1);
+				} else {
+					spin(1000);
+					us -= 1000;
+				}
+				#else
 				spin(1000);
 				us -= 1000;
+				#endif
+
 				if(us <= 0)
 					break;
 
@@ -288,6 +317,28 @@ void ui_window_display(ui_window_t *window, int timeout) {
 	main_console->reset();
 }
 
+/** Display a window.
+ * @param window	Window to display.
+ * @param timeout	Seconds to wait before closing the window if no input.
+ *			If 0, the window will not time out. */
+void ui_window_display(ui_window_t *window, int timeout) {
+	window_display(window, timeout, NULL);
+}
+
+#if CONFIG_KBOOT_PRELOAD
+
+/** Display a window, doing other work while waiting for it to time out.
+ * @param window	Window to display.
+ * @param timeout	Seconds to wait before closing the window if no input.
+ *			If 0, the window will not time out.
+ * @param idle		Function to call repeatedly while waiting to time out,
+ *			until it returns false or a key is pressed. */
+void ui_window_display_idle(ui_window_t *window, int timeout, ui_idle_func_t idle) {
+	window_display(window, timeout, idle);
+}
+
+#endif
+
 /** Print a line from a text view.
  * @param view		View to render.
  * @param line		Index of line to print. */
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief		File verification functions.
+ *
+ * Loaders can verify the SHA-256 digest of the files that they load against
+ * an expected value. Rather than hashing each file after it has been loaded,
+ * which would require a second pass over all of the data, the hash is
+ * computed inside file_read() as the data is read into its final location.
+ * Any parts of the file that the loader does not read (for example, ELF
+ * headers and debug information) are read and hashed in chunks at the end.
+ *
+ * Expected digests are given in the sha256 environment variable, which is a
+ * list of alternating path and digest strings, for example:
+ *
+ *   set "sha256" [
+ *       "/boot/kernel" "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08"
+ *       "/boot/initrd" "60303ae22b998861bce3b28f33eec1be758a213c86c93c076dbe9f558c11c752"
+ *   ]
+ *
+ * Paths must be given exactly as they are in the loader command. For modules
+ * loaded from a directory, the path is the directory path followed by a /
+ * and the module name. KBoot kernels can also give digests for their modules
+ * in the image, which are used if there is no digest in the environment.
+ *
+ * Digests are of the file contents as seen by the loader, i.e. after
+ * decompression if the file is compressed.
+ */
+
+#include <lib/ctype.h>
+#include <lib/string.h>
+
+#include <assert.h>
+#include <config.h>
+#include <loader.h>
+#include <memory.h>
+#include <time.h>
+#include <verify.h>
+
+/** Parse a hexadecimal SHA-256 digest string.
+ * @param str		String to parse.
+ * @param digest	Where to store the digest.
+ * @return		Whether the string was a valid digest. */
+bool verify_digest_parse(const char *str, uint8_t *digest) {
+	size_t i;
+	int ch;
+
+	for(i = 0; i < SHA256_DIGEST_SIZE * 2; i++) {
+		ch = str[i];
+		if(!isxdigit(ch))
+			return false;
+
+		ch = (isdigit(ch)) ? ch - '0' : tolower(ch) - 'a' + 10;
+		if(i % 2) {
+			digest[i / 2] |= ch;
+		} else {
+			digest[i / 2] = ch << 4;
+		}
+	}
+
+	return str[i] == 0;
+}
+
+/** Look up the expected digest for a file in the environment.
+ * @param path		Path that the file was opened with.
+ * @return		Digest string, or NULL if none specified. */
+static const char *lookup_digest(const char *path) {
+	value_list_t *list;
+	value_t *value;
+	size_t i;
+
+	value = environ_lookup(current_environ, "sha256");
+	if(!value)
+		return NULL;
+
+	if(value->type != VALUE_TYPE_LIST)
+		boot_error("sha256 must be a list of paths and digests");
+
+	list = value->list;
+	for(i = 0; i + 1 < list->count; i += 2) {
+		if(list->values[i].type != VALUE_TYPE_STRING
+			|| list->values[i + 1].type != VALUE_TYPE_STRING)
+		{
+			boot_error("sha256 must be a list of paths and digests");
+		}
+
+		if(strcmp(list->values[i].string, path) == 0)
+			return list->values[i + 1].string;
+	}
+
+	return NULL;
+}
+
+/**
+ * Start verifying a file.
+ *
+ * Looks up the expected digest for a file and, if there is one, starts
+ * hashing data as it is read from the file. A digest given in the
+ * environment takes precedence over one given by the caller. If there is no
+ * expected digest, the file will not be verified. This must be called
+ * before any of the file that is to be loaded has been read.
+ *
+ * @param handle	Handle to file.
+ * @param path		Path that the file was opened with.
+ * @param digest	Expected digest from the image, if any.
+ */
+void verify_begin(file_handle_t *handle, const char *path, const char *digest) {
+	file_verify_t *verify;
+	const char *str;
+
+	if(handle->verify)
+		return;
+
+	str = lookup_digest(path);
+	if(!str && !(str = digest))
+		return;
+
+	verify = kmalloc(sizeof(*verify));
+	if(!verify_digest_parse(str, verify->digest)) {
+		kfree(verify);
+		boot_error("Invalid SHA-256 digest for `%s'", path);
+	}
+
+	sha256_init(&verify->ctx);
+	verify->offset = 0;
+	verify->time = 0;
+	list_init(&verify->expected);
+	verify->mismatch = false;
+	handle->verify = verify;
+}
+
+/**
+ * Check data against a file when it is hashed.
+ *
+ * Records a copy of data that was read from a file outside of the hashed
+ * stream, either before verification began or ahead of the data that has
+ * been hashed so far. The copy is compared with the file contents as they
+ * are hashed, and verify_end() will fail if they differ, so the data can be
+ * trusted once the file has been verified. Data that has already been
+ * hashed cannot be checked, so this must be called before the loader has
+ * read past the start of the data.
+ *
+ * @param handle	Handle to file.
+ * @param data		Data read from the file.
+ * @param size		Size of the data.
+ * @param offset	Offset in the file that the data was read from.
+ */
+void verify_expect(file_handle_t *handle, const void *data, size_t size, offset_t offset) {
+	file_verify_t *verify = handle->verify;
+	verify_expect_t *expect;
+
+	if(!verify || !size)
+		return;
+
+	assert(offset >= verify->offset);
+
+	expect = kmalloc(sizeof(*expect) + size);
+	list_init(&expect->header);
+	expect->offset = offset;
+	expect->size = size;
+	memcpy(expect->data, data, size);
+	list_append(&verify->expected, &expect->header);
+}
+
+/**
+ * Finish verifying a file.
+ *
+ * Hashes any data in the file that has not yet been read, and checks the
+ * result against the expected digest. A boot error will be raised if the
+ * digest does not match, or if any data given to verify_expect() did not
+ * match the file.
+ *
+ * @param handle	Handle to file.
+ * @param name		Name of the file for error messages.
+ */
+void verify_end(file_handle_t *handle, const char *name) {
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	file_verify_t *verify;
+	offset_t size;
+
+	verify = handle->verify;
+	if(!verify)
+		return;
+
+	size = file_size(handle);
+	if(!file_verify_fill(handle, size))
+		boot_error("Could not read `%s'", name);
+
+	handle->verify = NULL;
+	sha256_final(&verify->ctx, digest);
+
+	#if CONFIG_KBOOT_HAVE_TRACE
+	dprintf("verify: hashed `%s' (%" PRIu64 " KiB) at %" PRIu64 " KiB/s\n", name,
+		size / 1024, (verify->time) ? (size / 1024) * arch_timestamp_frequency()
+			/ verify->time : 0);
+	#endif
+
+	if(memcmp(digest, verify->digest, SHA256_DIGEST_SIZE) != 0) {
+		verify_free(verify);
+		boot_error("SHA-256 digest mismatch for `%s'", name);
+	} else if(verify->mismatch) {
+		verify_free(verify);
+		boot_error("Data read from `%s' does not match its verified contents", name);
+	}
+
+	verify_free(verify);
+}
+
+/** Free verification state for a file.
+ * @param verify	Verification state to free. */
+void verify_free(file_verify_t *verify) {
+	verify_expect_t *expect;
+
+	LIST_FOREACH_SAFE(&verify->expected, iter) {
+		expect = list_entry(iter, verify_expect_t, header);
+		list_remove(&expect->header);
+		kfree(expect);
+	}
+
+	kfree(verify);
+}
@@ -0,0 +1,373 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2012 Alex Smith
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+# ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+# WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+# ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+# OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#
+
+# Boot time benchmark for the PC platform.
+#
+# Boots the loader in QEMU across a matrix of boot media, kernel compression,
+# module counts and loader types, and reports the time spent in each boot
+# phase. Timings are taken from the trace markers printed to the serial port
+# by a loader built with CONFIG_KBOOT_TRACE enabled.
+#
+# The KBoot test kernel is always available. Linux and Mezzanine are only
+# benchmarked if images for them are given on the command line. The ext2/ext4
+# configurations boot from a CD containing only the configuration file, which
+# switches to a hard disk image containing the kernel and modules.
+#
+# To measure the effect of disk seeks, place the work directory (TMPDIR) on a
+# rotational disk and pass --fragment and --no-host-cache: the modules are then
+# written to the ext2/ext4 images out of order and each read goes to the disk.
+#
+# A baseline can be saved with --save and later compared against with
+# --baseline. Any configuration whose total boot time increases by more than
+# the threshold percentage is reported and the script exits with status 1.
+
+import argparse
+import gzip
+import json
+import os
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# Phases in the order that they occur, matching trace.h.
+PHASES = ['entry', 'memory', 'disk', 'config', 'menu', 'kernel', 'mmu', 'modules', 'handoff']
+
+# Size of each generated module.
+MODULE_SIZE = 256 * 1024
+
+TRACE_RE = re.compile(r'^trace: (\w+) (\d+) (\d+)\s*$')
+
+def fail(msg):
+    print('bench-pc: %s' % (msg), file=sys.stderr)
+    sys.exit(2)
+
+# Copy a file into the staging directory, compressing it if requested.
+def stage_file(src, dest, compress):
+    if compress:
+        with open(src, 'rb') as fin, gzip.open(dest, 'wb') as fout:
+            shutil.copyfileobj(fin, fout)
+    else:
+        shutil.copyfile(src, dest)
+
+# Generate a module of pseudo-random (but reproducible) data.
+def stage_module(dest, index, compress):
+    data = bytearray(MODULE_SIZE)
+    seed = 0x12345678 + index
+    for i in range(0, MODULE_SIZE, 4):
+        seed = (seed * 1103515245 + 12345) & 0xffffffff
+        # Leave some redundancy so that compression has something to do.
+        data[i] = (seed >> 16) & 0xff
+        data[i + 1] = (seed >> 24) & 0x0f
+    opener = gzip.open if compress else open
+    with opener(dest, 'wb') as f:
+        f.write(data)
+
+# Describes a single benchmark configuration.
+class Config:
+    def __init__(self, loader, media, compress, modules):
+        self.loader = loader
+        self.media = media
+        self.compress = compress
+        self.modules = modules
+
+    def key(self):
+        return '%s/%s/%s/%d' % (self.loader, self.media, 'gz' if self.compress else 'raw', self.modules)
+
+    # Generate the configuration file for this configuration.
+    def loader_cfg(self, args, disk_prefix):
+        mods = ['/mod%d' % (i) for i in range(self.modules)]
+        lines = ['set "timeout" 0']
+        if self.media in ('ext2', 'ext4'):
+            lines.append('device "(hd0)"')
+        if self.loader == 'kboot':
+            lines.append('kboot "/kernel" [%s]' % (', '.join('"%s"' % (m) for m in mods)))
+        elif self.loader == 'linux':
+            initrd = ' "/initrd"' if args.linux_initrd else ''
+            lines.append('set "cmdline" "%s"' % (args.linux_cmdline))
+            lines.append('linux "/kernel"%s' % (initrd))
+        elif self.loader == 'mezzanine':
+            # The Mezzanine image is attached after any other disks.
+            lines.append('mezzanine "(hd%d)" [%s]' % (disk_prefix, ', '.join('"%s"' % (m) for m in mods)))
+        return '\n'.join(lines) + '\n'
+
+    # Populate a directory with the files needed for this configuration.
+    def stage(self, args, path):
+        if self.loader == 'kboot':
+            stage_file(args.kboot_kernel, os.path.join(path, 'kernel'), self.compress)
+        elif self.loader == 'linux':
+            stage_file(args.linux_kernel, os.path.join(path, 'kernel'), self.compress)
+            if args.linux_initrd:
+                stage_file(args.linux_initrd, os.path.join(path, 'initrd'), self.compress)
+        for i in range(self.modules):
+            stage_module(os.path.join(path, 'mod%d' % (i)), i, self.compress)
+
+# Write modules into a filesystem image in reverse order, separated by gaps,
+# so that reading them in the order they are specified requires seeking
+# backwards across the disk between each one.
+def fragment(image, moddir, mods, workdir):
+    filler = os.path.join(workdir, 'filler')
+    with open(filler, 'wb') as f:
+        f.write(bytes(MODULE_SIZE))
+    cmds = []
+    for i, mod in enumerate(reversed(mods)):
+        cmds.append('write %s %s' % (filler, '.filler%d' % (i)))
+        cmds.append('write %s %s' % (os.path.join(moddir, mod), mod))
+    cmds += ['rm .filler%d' % (i) for i in range(len(mods))]
+    script = os.path.join(workdir, 'debugfs.cmd')
+    with open(script, 'w') as f:
+        f.write('\n'.join(cmds) + '\n')
+    subprocess.check_call(['debugfs', '-w', '-f', script, image],
+        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+# Build the boot media for a configuration and return the QEMU arguments to
+# boot from it.
+def prepare(args, config, workdir):
+    build = args.build
+    staging = os.path.join(workdir, 'staging')
+    os.makedirs(os.path.join(staging, 'boot'))
+    qemu = []
+
+    # Disks are numbered in the order they are attached.
+    disks = 0
+    if config.media in ('ext2', 'ext4'):
+        disks = 1
+
+    cfg = config.loader_cfg(args, disks)
+    if config.media in ('ext2', 'ext4'):
+        # Create a filesystem image containing the kernel and modules, and a
+        # CD holding just the configuration.
+        fsdir = os.path.join(workdir, 'fs')
+        os.makedirs(fsdir)
+        config.stage(args, fsdir)
+        image = os.path.join(workdir, 'disk.img')
+        size = sum(os.path.getsize(os.path.join(fsdir, f)) for f in os.listdir(fsdir))
+        size = max(16, (size // (1024 * 1024)) * 2 + 8)
+        mods = []
+        if args.fragment:
+            # Keep the modules out of the initial population so that they
+            # can be laid out separately below.
+            moddir = os.path.join(workdir, 'mods')
+            os.makedirs(moddir)
+            mods = sorted(f for f in os.listdir(fsdir) if f.startswith('mod'))
+            for f in mods:
+                shutil.move(os.path.join(fsdir, f), moddir)
+        subprocess.check_call(['mke2fs', '-q', '-F', '-t', config.media, '-d', fsdir, image,
+            '%dM' % (size)], stdout=subprocess.DEVNULL)
+        if mods:
+            fragment(image, moddir, mods, workdir)
+        cache = ',cache=none' if args.no_host_cache else ''
+        qemu += ['-drive', 'file=%s,format=raw,if=ide,index=0,media=disk%s' % (image, cache)]
+    else:
+        config.stage(args, staging)
+
+    with open(os.path.join(staging, 'boot', 'loader.cfg'), 'w') as f:
+        f.write(cfg)
+
+    if config.media == 'pxe':
+        with open(os.path.join(staging, 'pxeboot.img'), 'wb') as f:
+            for src in ('source/platform/pc/stage1/pxeboot', 'source/loader'):
+                with open(os.path.join(build, src), 'rb') as s:
+                    f.write(s.read())
+        qemu += ['-netdev', 'user,id=net0,tftp=%s,bootfile=/pxeboot.img' % (staging),
+            '-device', 'e1000,netdev=net0', '-boot', 'n']
+    else:
+        iso = os.path.join(workdir, 'boot.iso')
+        subprocess.check_call([os.path.join(os.path.dirname(__file__), 'mkiso-pc.sh'),
+            build, staging, iso], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        qemu += ['-cdrom', iso, '-boot', 'd']
+
+    if config.loader == 'mezzanine':
+        qemu += ['-drive', 'file=%s,format=raw,if=ide,index=%d,media=disk,snapshot=on' % (
+            args.mezzanine_image, disks)]
+
+    return qemu
+
+# Parse the trace markers from a serial log. Returns a dictionary of phase
+# durations in milliseconds, plus the total time to kernel entry. Each marker
+# is recorded at the start of its phase, which lasts until the next marker.
+# Loaders do not record every phase, so the markers are taken in the order
+# that they were recorded.
+def parse(log):
+    stamps = {}
+    freq = 0
+    for line in log.splitlines():
+        m = TRACE_RE.match(line)
+        if m:
+            stamps[m.group(1)] = int(m.group(2))
+            freq = int(m.group(3))
+    if 'entry' not in stamps or 'handoff' not in stamps or not freq:
+        return None
+
+    result = {}
+    seen = sorted((p for p in PHASES if p in stamps), key = lambda p: stamps[p])
+    for i, phase in enumerate(seen[:-1]):
+        result[phase] = (stamps[seen[i + 1]] - stamps[phase]) * 1000.0 / freq
+    result['total'] = (stamps['handoff'] - stamps['entry']) * 1000.0 / freq
+    return result
+
+# Boot a configuration once and return the parsed timings.
+def run_once(args, config):
+    workdir = tempfile.mkdtemp(prefix='kboot-bench-')
+    try:
+        log = os.path.join(workdir, 'serial.log')
+        cmd = [args.qemu, '-m', str(args.memory), '-display', 'none', '-no-reboot',
+            '-serial', 'file:%s' % (log), '-monitor', 'none']
+        if args.kvm:
+            cmd += ['-enable-kvm', '-cpu', 'host']
+        cmd += prepare(args, config, workdir)
+
+        proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        data = ''
+        deadline = time.time() + args.timeout
+        while time.time() < deadline and proc.poll() is None:
+            time.sleep(0.1)
+            if os.path.exists(log):
+                with open(log, errors='replace') as f:
+                    data = f.read()
+                if 'trace: handoff' in data:
+                    break
+        if proc.poll() is None:
+            proc.kill()
+            proc.wait()
+        with open(log, errors='replace') as f:
+            data = f.read()
+
+        if args.verbose:
+            sys.stderr.write(data)
+        return parse(data)
+    finally:
+        shutil.rmtree(workdir)
+
+# Run a configuration several times and return the median of each phase.
+def run(args, config):
+    runs = []
+    for i in range(args.runs):
+        result = run_once(args, config)
+        if result is None:
+            print('%s: boot did not reach kernel entry' % (config.key()), file=sys.stderr)
+            return None
+        runs.append(result)
+    return {k: statistics.median(r.get(k, 0.0) for r in runs) for k in runs[0]}
+
+def print_table(results, baseline):
+    columns = PHASES[:-1] + ['total']
+    width = max([len(k) for k in results] + [6])
+    print('%-*s %s' % (width, 'config', ' '.join('%9s' % (c) for c in columns)))
+    for key, result in results.items():
+        line = '%-*s %s' % (width, key, ' '.join('%9.2f' % (result.get(c, 0.0)) for c in columns))
+        if baseline and key in baseline:
+            change = (result['total'] - baseline[key]['total']) * 100.0 / baseline[key]['total']
+            line += ' %+7.1f%%' % (change)
+        print(line)
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark PC boot times in QEMU.')
+    parser.add_argument('--build', default='build/x86-pc', help='build directory')
+    parser.add_argument('--loaders', default='kboot,linux,mezzanine')
+    parser.add_argument('--media', default='iso9660,ext2,ext4,pxe')
+    parser.add_argument('--modules', default='0,4,16', help='module counts to test')
+    parser.add_argument('--compress', default='raw,gz', help='kernel/module compression')
+    parser.add_argument('--runs', type=int, default=3, help='boots per configuration')
+    parser.add_argument('--timeout', type=float, default=60, help='seconds to wait for a boot')
+    parser.add_argument('--memory', type=int, default=512, help='guest memory in MB')
+    parser.add_argument('--qemu', default='qemu-system-x86_64')
+    parser.add_argument('--kvm', action='store_true', default=os.access('/dev/kvm', os.W_OK))
+    parser.add_argument('--no-kvm', dest='kvm', action='store_false')
+    parser.add_argument('--kboot-kernel', help='KBoot kernel (default: 64-bit test kernel)')
+    parser.add_argument('--linux-kernel', help='Linux kernel image')
+    parser.add_argument('--linux-initrd', help='Linux initrd image')
+    parser.add_argument('--linux-cmdline', default='console=ttyS0')
+    parser.add_argument('--mezzanine-image', help='Mezzanine disk image')
+    parser.add_argument('--fragment', action='store_true',
+        help='lay out modules on ext2/ext4 images in reverse order with gaps')
+    parser.add_argument('--no-host-cache', action='store_true',
+        help='bypass the host page cache for disk images (use on an HDD)')
+    parser.add_argument('--baseline', help='baseline results to compare against')
+    parser.add_argument('--threshold', type=float, default=10.0,
+        help='regression threshold in percent (default: 10)')
+    parser.add_argument('--save', help='file to save results to')
+    parser.add_argument('-v', '--verbose', action='store_true', help='print serial logs')
+    args = parser.parse_args()
+
+    if not os.path.exists(os.path.join(args.build, 'source', 'loader')):
+        fail('loader not built in %s' % (args.build))
+    config_path = os.path.join(args.build, '..', '..', '.config')
+    if os.path.exists(config_path):
+        with open(config_path) as f:
+            if 'CONFIG_KBOOT_TRACE=y' not in f.read():
+                fail('loader must be built with CONFIG_KBOOT_TRACE enabled')
+    if not args.kboot_kernel:
+        args.kboot_kernel = os.path.join(args.build, 'test', 'test64.elf')
+
+    configs = []
+    for loader in args.loaders.split(','):
+        if loader == 'linux' and not args.linux_kernel:
+            print('bench-pc: skipping linux, no --linux-kernel given', file=sys.stderr)
+            continue
+        elif loader == 'mezzanine' and not args.mezzanine_image:
+            print('bench-pc: skipping mezzanine, no --mezzanine-image given', file=sys.stderr)
+            continue
+        elif loader not in ('kboot', 'linux', 'mezzanine'):
+            fail('unknown loader %s' % (loader))
+
+        for media in args.media.split(','):
+            if media not in ('iso9660', 'ext2', 'ext4', 'pxe'):
+                fail('unknown media %s' % (media))
+            for compress in args.compress.split(','):
+                # Mezzanine images are raw disks and are never compressed.
+                if loader == 'mezzanine' and compress == 'gz':
+                    continue
+                # Linux only takes an initrd, module counts don't apply.
+                counts = [0] if loader == 'linux' else [int(n) for n in args.modules.split(',')]
+                for count in counts:
+                    configs.append(Config(loader, media, compress == 'gz', count))
+
+    results = {}
+    for config in configs:
+        result = run(args, config)
+        if result is not None:
+            results[config.key()] = result
+
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    print_table(results, baseline)
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    status = 0 if len(results) == len(configs) else 1
+    if baseline:
+        for key, result in results.items():
+            if key not in baseline:
+                continue
+            limit = baseline[key]['total'] * (1 + args.threshold / 100.0)
+            if result['total'] > limit:
+                print('REGRESSION: %s: %.2fms (baseline %.2fms, limit %.2fms)' % (
+                    key, result['total'], baseline[key]['total'], limit))
+                status = 1
+    sys.exit(status)
+
+if __name__ == '__main__':
+    main()
@@ -310,6 +310,30 @@ static void dump_e820_tag(kboot_tag_e820_t *tag) {
 	kprintf("  type   = %" PRIu32 " (%s)\n", tag->type, e820_tag_type(tag->type));
 }
 
+/** Dump a memory statistics tag. */
+static void dump_memstats_tag(kboot_tag_memstats_t *tag) {
+	kprintf("KBOOT_TAG_MEMSTATS:\n");
+	kprintf("  heap_size      = %" PRIu32 "\n", tag->heap_size);
+	kprintf("  heap_current   = %" PRIu32 "\n", tag->heap_current);
+	kprintf("  heap_peak      = %" PRIu32 "\n", tag->heap_peak);
+	kprintf("  heap_largest   = %" PRIu32 "\n", tag->heap_largest);
+	kprintf("  heap_allocs    = %" PRIu32 "\n", tag->heap_allocs);
+	kprintf("  heap_frees     = %" PRIu32 "\n", tag->heap_frees);
+	kprintf("  phys_allocated = 0x%" PRIx64 "\n", tag->phys_allocated);
+	kprintf("  phys_allocs    = %" PRIu32 "\n", tag->phys_allocs);
+}
+
+/** Dump a timing tag. */
+static void dump_timing_tag(kboot_tag_timing_t *tag) {
+	uint32_t i;
+
+	kprintf("KBOOT_TAG_TIMING:\n");
+	kprintf("  frequency = %" PRIu64 "\n", tag->frequency);
+	kprintf("  count     = %" PRIu32 "\n", tag->count);
+	for(i = 0; i < tag->count; i++)
+		kprintf("  timestamps[%" PRIu32 "] = %" PRIu64 "\n", i, tag->timestamps[i]);
+}
+
 /** Entry point of the test kernel.
  * @param magic		KBoot magic number.
  * @param tags		Tag list pointer. */
@@ -357,6 +381,12 @@ void kmain(uint32_t magic, kboot_tag_t *tags) {
 		case KBOOT_TAG_E820:
 			dump_e820_tag((kboot_tag_e820_t *)tags);
 			break;
+		case KBOOT_TAG_MEMSTATS:
+			dump_memstats_tag((kboot_tag_memstats_t *)tags);
+			break;
+		case KBOOT_TAG_TIMING:
+			dump_timing_tag((kboot_tag_timing_t *)tags);
+			break;
 		}
 
 		tags = (kboot_tag_t *)ROUND_UP((ptr_t)tags + tags->size, 8);
@@ -0,0 +1,18 @@
+#!/bin/bash -e
+#
+# Build a bootable PC CD image from a staging directory.
+#
+# Usage: mkiso-pc.sh <build dir> <staging dir> <output>
+#
+# The staging directory should contain the files to put on the image,
+# including boot/loader.cfg. The CD boot loader is added to it.
+#
+
+if [ $# -ne 3 ]; then
+	echo "Usage: $0 <build dir> <staging dir> <output>"
+	exit 1
+fi
+
+mkdir -p $2/boot
+cat $1/source/platform/pc/stage1/cdboot $1/source/loader > $2/boot/cdboot.img
+mkisofs -J -R -l -b boot/cdboot.img -V "CDROM" -boot-load-size 4 -boot-info-table -no-emul-boot -o $3 $2
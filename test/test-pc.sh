@@ -4,7 +4,6 @@ scons
 scons test
 
 mkdir -p isobuild/boot
-cat build/x86-pc/source/platform/pc/stage1/cdboot build/x86-pc/source/loader > isobuild/boot/cdboot.img
 cp build/x86-pc/test/test32.elf build/x86-pc/test/test64.elf isobuild/
 
 if grep -q CONFIG_KBOOT_UI=y .config; then
@@ -35,6 +34,6 @@ kboot "/test${1}.elf" ["/test${1}.elf"]
 EOF
 fi
 
-mkisofs -J -R -l -b boot/cdboot.img -V "CDROM" -boot-load-size 4 -boot-info-table -no-emul-boot -o build/x86-pc/test.iso isobuild
+$(dirname $0)/mkiso-pc.sh build/x86-pc isobuild build/x86-pc/test.iso
 rm -rf isobuild
 qemu-system-x86_64 -cdrom build/x86-pc/test.iso -serial stdio -vga std -boot d -m 512 -monitor vc:1024x768
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Virtual region allocator benchmark.
+ *
+ * Models the allocator usage of a KBoot kernel with a large number of fixed
+ * virtual mappings (KBOOT_ITAG_MAPPING) followed by a large number of
+ * allocations for modules and other loader-allocated regions.
+ */
+
+#include <lib/allocator.h>
+#include <lib/utility.h>
+
+#include <assert.h>
+#include <memory.h>
+
+#include "bench.h"
+
+/** Size of simulated physical memory, which range structures come from. */
+#define ALLOCATOR_BENCH_MEMORY	0x10000000ul
+
+/** Spacing between fixed mappings. */
+#define MAPPING_STRIDE		0x40000
+
+/** Allocation alignments used. */
+static const target_size_t alignments[] = {
+	0, 0, 0, 0x10000, 0x200000,
+};
+
+/** Run the allocator benchmark.
+ * @param count		Number of operations of each type to perform.
+ * @param image		Unused.
+ * @return		0 on success, 1 on failure. */
+int bench_allocator(unsigned long count, const char *image) {
+	target_ptr_t *addrs, addr;
+	target_size_t *sizes, size, align;
+	unsigned long start, i, j;
+	allocator_t alloc;
+	void *mem;
+
+	mem = bench_phys_map(ALLOCATOR_BENCH_MEMORY);
+	if(!mem)
+		return 1;
+
+	bench_phys_offset = (ptr_t)mem;
+	phys_memory_add(0x100000, ALLOCATOR_BENCH_MEMORY - 0x100000, PHYS_MEMORY_FREE);
+
+	addrs = kmalloc(sizeof(*addrs) * count * 2);
+	sizes = kmalloc(sizeof(*sizes) * count * 2);
+
+	/* Generate fixed mappings in a random order. */
+	for(i = 0; i < count; i++) {
+		addrs[i] = 0xffff800000000000ull + (i * MAPPING_STRIDE)
+			+ ((bench_random() % 16) * PAGE_SIZE);
+		sizes[i] = ((bench_random() % 32) + 1) * PAGE_SIZE;
+	}
+	for(i = count - 1; i > 0; i--) {
+		j = bench_random() % (i + 1);
+		addr = addrs[i]; addrs[i] = addrs[j]; addrs[j] = addr;
+		size = sizes[i]; sizes[i] = sizes[j]; sizes[j] = size;
+	}
+
+	allocator_init(&alloc, 0, 0);
+
+	start = bench_time();
+	for(i = 0; i < count; i++) {
+		if(!allocator_insert(&alloc, addrs[i], sizes[i])) {
+			internal_error("Failed to insert mapping 0x%" PRIx64 " (0x%" PRIx64 ")",
+				addrs[i], sizes[i]);
+		}
+	}
+	bench_report("insert", count, bench_time() - start);
+
+	start = bench_time();
+	for(i = 0; i < count; i++) {
+		align = alignments[i % ARRAY_SIZE(alignments)];
+		size = ((bench_random() % 16) + 1) * PAGE_SIZE;
+		if(!allocator_alloc(&alloc, size, align, &addrs[count + i]))
+			internal_error("Failed to allocate 0x%" PRIx64, size);
+
+		assert(!align || !(addrs[count + i] % align));
+		sizes[count + i] = size;
+	}
+	bench_report("alloc", count, bench_time() - start);
+
+	/* Every region is now allocated, so inserting any of them must fail. */
+	start = bench_time();
+	for(i = 0; i < count * 2; i++) {
+		if(allocator_insert(&alloc, addrs[i], sizes[i])) {
+			internal_error("Conflicting insert of 0x%" PRIx64 " (0x%" PRIx64 ") succeeded",
+				addrs[i], sizes[i]);
+		}
+	}
+	bench_report("insert (conflict)", count * 2, bench_time() - start);
+
+	start = bench_time();
+	for(i = 0; i < count; i++) {
+		addr = 0xffff800000000000ull + ((bench_random() % (count * 2)) * (MAPPING_STRIDE / 2));
+		allocator_reserve(&alloc, addr, MAPPING_STRIDE);
+	}
+	bench_report("reserve", count, bench_time() - start);
+
+	kfree(sizes);
+	kfree(addrs);
+	return 0;
+}
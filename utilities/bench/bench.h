@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Host benchmark definitions.
+ *
+ * This header is shared between the code built against the loader headers
+ * (the loader core, the support code and the benchmark drivers) and the host
+ * support code, which is built against the host C library. It must therefore
+ * only use basic C types.
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+/** Structure describing a benchmark. */
+typedef struct benchmark {
+	const char *name;		/**< Name of the benchmark. */
+	unsigned long count;		/**< Default iteration count. */
+	int need_image;			/**< Whether a disk image is required. */
+
+	/** Run the benchmark.
+	 * @param count		Number of iterations to perform.
+	 * @param image		Path to disk image (if required).
+	 * @return		0 on success, 1 on failure. */
+	int (*func)(unsigned long count, const char *image);
+} benchmark_t;
+
+extern int bench_verbose;
+extern const char *bench_disk_image;
+
+extern unsigned long bench_time(void);
+extern void bench_report(const char *name, unsigned long count, unsigned long ns);
+extern unsigned long bench_random(void);
+
+extern void bench_putc(char ch, int debug);
+extern void bench_abort(void) __attribute__((noreturn));
+
+extern int bench_file_open(const char *path, unsigned long *sizep);
+extern int bench_file_read(int fd, void *buf, unsigned long count, unsigned long offset);
+extern void *bench_phys_map(unsigned long size);
+
+extern unsigned long bench_disk_reads;
+extern unsigned long bench_disk_bytes;
+extern unsigned long bench_disk_seeks;
+extern unsigned long bench_disk_distance;
+
+extern int bench_allocator(unsigned long count, const char *image);
+extern int bench_fs(unsigned long count, const char *image);
+extern int bench_mezzanine(unsigned long count, const char *image);
+
+#endif /* __BENCH_H */
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		File-backed disk device.
+ *
+ * Provides a disk device backed by an image file on the host, which is added
+ * as the boot disk when disk_init() is called.
+ */
+
+#include <disk.h>
+#include <memory.h>
+
+#include "bench.h"
+
+/** Block size of the disk. */
+#define FILE_DISK_BLOCK_SIZE	512
+
+/** Structure for a file-backed disk. */
+typedef struct file_disk {
+	disk_t disk;			/**< Disk device header. */
+	int fd;				/**< File descriptor for the image. */
+} file_disk_t;
+
+/** Path to the image to use as the boot disk. */
+const char *bench_disk_image = NULL;
+
+/** I/O statistics for the file-backed disk. */
+unsigned long bench_disk_reads = 0;	/**< Number of read requests. */
+unsigned long bench_disk_bytes = 0;	/**< Number of bytes read. */
+unsigned long bench_disk_seeks = 0;	/**< Reads not following the previous. */
+unsigned long bench_disk_distance = 0;	/**< Total blocks seeked over. */
+
+/** Block following the last one read. */
+static uint64_t next_lba = 0;
+
+/** Check if a partition is the boot partition.
+ * @param disk		Disk the partition is on.
+ * @param id		ID of partition.
+ * @param lba		Block that the partition starts at.
+ * @return		Whether partition is a boot partition. */
+static bool file_disk_is_boot_partition(disk_t *disk, uint8_t id, uint64_t lba) {
+	/* Use the first partition. */
+	return (id == 0);
+}
+
+/** Read blocks from a file-backed disk.
+ * @param disk		Disk being read from.
+ * @param buf		Buffer to read into.
+ * @param lba		Block number to start reading from.
+ * @param count		Number of blocks to read.
+ * @return		Whether reading succeeded. */
+static bool file_disk_read(disk_t *disk, void *buf, uint64_t lba, size_t count) {
+	file_disk_t *file = (file_disk_t *)disk;
+
+	bench_disk_reads++;
+	bench_disk_bytes += count * FILE_DISK_BLOCK_SIZE;
+	if(lba != next_lba) {
+		bench_disk_seeks++;
+		bench_disk_distance += (lba > next_lba) ? lba - next_lba : next_lba - lba;
+	}
+	next_lba = lba + count;
+
+	return bench_file_read(file->fd, buf, count * FILE_DISK_BLOCK_SIZE,
+		lba * FILE_DISK_BLOCK_SIZE);
+}
+
+/** Operations for a file-backed disk. */
+static disk_ops_t file_disk_ops = {
+	.is_boot_partition = file_disk_is_boot_partition,
+	.read = file_disk_read,
+};
+
+/** Detect all disk devices. */
+void platform_disk_detect(void) {
+	unsigned long size;
+	file_disk_t *file;
+	int fd;
+
+	if(!bench_disk_image)
+		return;
+
+	fd = bench_file_open(bench_disk_image, &size);
+	if(fd < 0)
+		return;
+
+	file = kmalloc(sizeof(*file));
+	file->fd = fd;
+	disk_add(&file->disk, "hd0", 0x80, FILE_DISK_BLOCK_SIZE,
+		size / FILE_DISK_BLOCK_SIZE, &file_disk_ops, true);
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Filesystem benchmark.
+ *
+ * Mounts a disk image through the loader's disk and filesystem code and times
+ * directory iteration, file_open() and file_read() over every file on it.
+ */
+
+#include <lib/string.h>
+#include <lib/utility.h>
+
+#include <device.h>
+#include <fs.h>
+#include <memory.h>
+
+#include "bench.h"
+
+/** Maximum number of files to benchmark. */
+#define FS_BENCH_MAX_FILES	4096
+
+/** Maximum path length. */
+#define FS_BENCH_PATH_MAX	1024
+
+/** Size of reads to use for whole file reads. */
+#define FS_BENCH_READ_SIZE	0x10000
+
+/** Size of reads to use for random reads. */
+#define FS_BENCH_RANDOM_SIZE	512
+
+/** State for the directory walk. */
+typedef struct fs_walk {
+	char path[FS_BENCH_PATH_MAX];	/**< Path of current directory. */
+	size_t len;			/**< Length of current path. */
+	char *files[FS_BENCH_MAX_FILES];/**< Paths of files found. */
+	offset_t sizes[FS_BENCH_MAX_FILES];
+	offset_t locations[FS_BENCH_MAX_FILES];
+	size_t count;			/**< Number of files found. */
+	unsigned long entries;		/**< Number of entries seen. */
+} fs_walk_t;
+
+/** Directory walk callback.
+ * @param name		Name of the entry.
+ * @param handle	Handle to the entry.
+ * @param _walk		Walk state.
+ * @return		Whether to continue iteration. */
+static bool fs_walk_cb(const char *name, file_handle_t *handle, void *_walk) {
+	fs_walk_t *walk = _walk;
+	size_t len, prev;
+
+	if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+		return true;
+
+	walk->entries++;
+
+	len = strlen(name);
+	if(walk->len + len + 2 > FS_BENCH_PATH_MAX)
+		return true;
+
+	prev = walk->len;
+	walk->path[walk->len++] = '/';
+	memcpy(&walk->path[walk->len], name, len + 1);
+	walk->len += len;
+
+	if(handle->directory) {
+		dir_iterate(handle, fs_walk_cb, walk);
+	} else if(walk->count < FS_BENCH_MAX_FILES) {
+		walk->files[walk->count++] = kstrdup(walk->path);
+	}
+
+	walk->len = prev;
+	walk->path[prev] = 0;
+	return true;
+}
+
+/** Read every file in a given order, one at a time.
+ * @param walk		Walk state containing the files.
+ * @param order		Indices of the files in the order to read them.
+ * @param buf		Buffer to read into.
+ * @param name		Name to report the results under.
+ * @return		Whether all reads succeeded. */
+static bool fs_read_ordered(fs_walk_t *walk, size_t *order, void *buf, const char *name) {
+	unsigned long start, reads, seeks, distance;
+	file_handle_t *handle;
+	offset_t offset, size;
+	size_t j;
+
+	reads = bench_disk_reads;
+	seeks = bench_disk_seeks;
+	distance = bench_disk_distance;
+	start = bench_time();
+	for(j = 0; j < walk->count; j++) {
+		handle = file_open(walk->files[order[j]], NULL);
+		for(offset = 0; offset < walk->sizes[order[j]]; offset += size) {
+			size = MIN(walk->sizes[order[j]] - offset, FS_BENCH_READ_SIZE);
+			if(!file_read(handle, buf, size, offset)) {
+				kprintf("Failed to read '%s'\n", walk->files[order[j]]);
+				return false;
+			}
+		}
+
+		file_close(handle);
+	}
+	bench_report(name, walk->count, bench_time() - start);
+	kprintf("  %lu disk reads (%lu non-sequential, %lu blocks seeked)\n",
+		bench_disk_reads - reads, bench_disk_seeks - seeks,
+		bench_disk_distance - distance);
+	return true;
+}
+
+/** Run the filesystem benchmark.
+ * @param count		Number of passes over the filesystem to make.
+ * @param image		Path to disk image.
+ * @return		0 on success, 1 on failure. */
+int bench_fs(unsigned long count, const char *image) {
+	unsigned long start, i, ops, bytes;
+	file_handle_t *handle;
+	offset_t offset, size;
+	fs_walk_t *walk;
+	size_t j, k, largest;
+	size_t *order;
+	void *buf;
+
+	bench_disk_image = image;
+	disk_init();
+	if(!boot_device || !boot_device->fs) {
+		kprintf("No filesystem found on '%s'\n", image);
+		return 1;
+	}
+
+	kprintf("Mounted '%s' (label: '%s', UUID: '%s')\n", image,
+		(boot_device->fs->label) ? boot_device->fs->label : "",
+		(boot_device->fs->uuid) ? boot_device->fs->uuid : "");
+
+	walk = kmalloc(sizeof(*walk));
+	walk->path[0] = 0;
+	walk->len = 0;
+	walk->count = 0;
+	walk->entries = 0;
+
+	/* Walk the whole filesystem to find files to test with. */
+	start = bench_time();
+	handle = file_open("/", NULL);
+	if(!handle || !dir_iterate(handle, fs_walk_cb, walk)) {
+		kprintf("Failed to iterate root directory\n");
+		return 1;
+	}
+	file_close(handle);
+	bench_report("dir_iterate", walk->entries, bench_time() - start);
+
+	if(!walk->count) {
+		kprintf("No files found\n");
+		return 1;
+	}
+
+	/* Get file sizes through file_open(), handles given to the iteration
+	 * callback are not set up for decompression and would give the size
+	 * of compressed files on disk. */
+	for(j = 0; j < walk->count; j++) {
+		handle = file_open(walk->files[j], NULL);
+		if(!handle) {
+			kprintf("Failed to open '%s'\n", walk->files[j]);
+			return 1;
+		}
+
+		walk->sizes[j] = file_size(handle);
+		walk->locations[j] = file_location(handle);
+		file_close(handle);
+	}
+
+	start = bench_time();
+	for(i = 0; i < count; i++) {
+		for(j = 0; j < walk->count; j++) {
+			handle = file_open(walk->files[j], NULL);
+			if(!handle) {
+				kprintf("Failed to open '%s'\n", walk->files[j]);
+				return 1;
+			}
+
+			file_close(handle);
+		}
+	}
+	bench_report("file_open", count * walk->count, bench_time() - start);
+
+	buf = kmalloc(FS_BENCH_READ_SIZE);
+	ops = bytes = 0;
+	start = bench_time();
+	for(i = 0; i < count; i++) {
+		for(j = 0; j < walk->count; j++) {
+			handle = file_open(walk->files[j], NULL);
+			for(offset = 0; offset < walk->sizes[j]; offset += size) {
+				size = MIN(walk->sizes[j] - offset, FS_BENCH_READ_SIZE);
+				if(!file_read(handle, buf, size, offset)) {
+					kprintf("Failed to read '%s'\n", walk->files[j]);
+					return 1;
+				}
+
+				ops++;
+				bytes += size;
+			}
+
+			file_close(handle);
+		}
+	}
+	bench_report("file_read (sequential)", ops, bench_time() - start);
+	kprintf("  %lu bytes read\n", bytes);
+
+	/* Read each file once in path order, as a configuration would usually
+	 * list modules, then in the order of their data on disk (as the KBoot
+	 * loader does for modules), to compare the number of seeks. */
+	order = kmalloc(sizeof(*order) * walk->count);
+	for(j = 0; j < walk->count; j++) {
+		for(k = j; k > 0 && strcmp(walk->files[order[k - 1]], walk->files[j]) > 0; k--)
+			order[k] = order[k - 1];
+		order[k] = j;
+	}
+	if(!fs_read_ordered(walk, order, buf, "file_read (path order)"))
+		return 1;
+	for(j = 0; j < walk->count; j++) {
+		for(k = j; k > 0 && walk->locations[order[k - 1]] > walk->locations[j]; k--)
+			order[k] = order[k - 1];
+		order[k] = j;
+	}
+	if(!fs_read_ordered(walk, order, buf, "file_read (disk order)"))
+		return 1;
+	kfree(order);
+
+	/* Random small reads from the largest file. */
+	for(j = 1, largest = 0; j < walk->count; j++) {
+		if(walk->sizes[j] > walk->sizes[largest])
+			largest = j;
+	}
+
+	if(walk->sizes[largest] >= FS_BENCH_RANDOM_SIZE) {
+		handle = file_open(walk->files[largest], NULL);
+		ops = count * 100;
+		start = bench_time();
+		for(i = 0; i < ops; i++) {
+			offset = bench_random() % (walk->sizes[largest] - FS_BENCH_RANDOM_SIZE + 1);
+			if(!file_read(handle, buf, FS_BENCH_RANDOM_SIZE, offset)) {
+				kprintf("Failed to read '%s'\n", walk->files[largest]);
+				return 1;
+			}
+		}
+		bench_report("file_read (random)", ops, bench_time() - start);
+		file_close(handle);
+	}
+
+	memory_stats_dump();
+	return 0;
+}
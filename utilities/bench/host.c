@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Host benchmark support code.
+ *
+ * Provides the services needed by the loader support code using the host C
+ * library, and the benchmark program entry point.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+/** List of benchmarks. */
+static benchmark_t benchmarks[] = {
+	{ "allocator", 10000, 0, bench_allocator },
+	{ "fs", 100, 1, bench_fs },
+	{ "mezzanine", 1, 1, bench_mezzanine },
+};
+
+/** Whether to print debug output from the loader. */
+int bench_verbose = 0;
+
+/** State for the random number generator. */
+static unsigned long random_state = 88172645463325252ul;
+
+/** Get the current time.
+ * @return		Current time in nanoseconds. */
+unsigned long bench_time(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/** Print the result of a timed operation.
+ * @param name		Name of the operation.
+ * @param count		Number of times the operation was performed.
+ * @param ns		Total time taken in nanoseconds. */
+void bench_report(const char *name, unsigned long count, unsigned long ns) {
+	printf("  %-24s %10lu ops %12.3f ms %10.1f ns/op\n", name, count,
+		(double)ns / 1000000.0, (count) ? (double)ns / count : 0.0);
+}
+
+/** Get a pseudo-random number.
+ * @return		Random number (deterministic between runs). */
+unsigned long bench_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+/** Write a character of loader output.
+ * @param ch		Character to write.
+ * @param debug		Whether the character is debug output. */
+void bench_putc(char ch, int debug) {
+	if(!debug || bench_verbose)
+		fputc(ch, (debug) ? stderr : stdout);
+}
+
+/** Abort the benchmark after an error. */
+void bench_abort(void) {
+	fflush(stdout);
+	abort();
+}
+
+/** Open a file for reading.
+ * @param path		Path to file.
+ * @param sizep		Where to store size of the file.
+ * @return		File descriptor, or -1 on failure. */
+int bench_file_open(const char *path, unsigned long *sizep) {
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	if(fstat(fd, &st) != 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+
+	*sizep = st.st_size;
+	return fd;
+}
+
+/** Read from a file.
+ * @param fd		File descriptor to read from.
+ * @param buf		Buffer to read into.
+ * @param count		Number of bytes to read.
+ * @param offset	Offset to read from.
+ * @return		Whether the read was successful. */
+int bench_file_read(int fd, void *buf, unsigned long count, unsigned long offset) {
+	ssize_t ret;
+
+	while(count) {
+		ret = pread(fd, buf, count, offset);
+		if(ret <= 0)
+			return 0;
+
+		buf = (char *)buf + ret;
+		count -= ret;
+		offset += ret;
+	}
+
+	return 1;
+}
+
+/** Map memory to use as simulated physical memory.
+ * @param size		Size of the memory. Pages are only backed when they
+ *			are first touched, so this can exceed host memory.
+ * @return		Address of the memory, or NULL on failure. */
+void *bench_phys_map(unsigned long size) {
+	void *addr;
+
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(addr == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+
+	return addr;
+}
+
+/** Print usage information.
+ * @param argv0		Program name. */
+static void usage(const char *argv0) {
+	size_t i;
+
+	fprintf(stderr, "Usage: %s [-v] <benchmark> [<image>] [<count>]\n\n", argv0);
+	fprintf(stderr, "Benchmarks:\n");
+	for(i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+		fprintf(stderr, "  %-12s%s\n", benchmarks[i].name,
+			(benchmarks[i].need_image) ? " (requires image)" : "");
+	}
+}
+
+/** Main function of the benchmark program.
+ * @param argc		Argument count.
+ * @param argv		Argument array.
+ * @return		Exit status. */
+int main(int argc, char **argv) {
+	const char *image = NULL;
+	unsigned long count;
+	benchmark_t *bench;
+	int i = 1;
+	size_t j;
+
+	if(i < argc && strcmp(argv[i], "-v") == 0) {
+		bench_verbose = 1;
+		i++;
+	}
+
+	if(i >= argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for(j = 0, bench = NULL; j < sizeof(benchmarks) / sizeof(benchmarks[0]); j++) {
+		if(strcmp(argv[i], benchmarks[j].name) == 0) {
+			bench = &benchmarks[j];
+			break;
+		}
+	}
+
+	if(!bench) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	i++;
+	if(bench->need_image) {
+		if(i >= argc) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		image = argv[i++];
+	}
+
+	count = (i < argc) ? strtoul(argv[i], NULL, 0) : bench->count;
+
+	printf("%s:\n", bench->name);
+	return (bench->func(count, image) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Host core definitions.
+ */
+
+#ifndef __ARCH_LOADER_H
+#define __ARCH_LOADER_H
+
+/** The host build can access the whole of its address space. */
+#define LOADER_PHYS_MAX		((phys_ptr_t)-1)
+
+/** Use a larger heap so that benchmarks can be run at a larger scale. */
+#define HEAP_SIZE		0x4000000
+
+/** Offset of simulated physical memory in the host address space. */
+#define LOADER_VIRT_OFFSET	bench_phys_offset
+
+extern unsigned long bench_phys_offset;
+
+#endif /* __ARCH_LOADER_H */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief		Host BIOS interface definitions.
+ *
+ * Replaces the PC platform's BIOS header for code built for the host. The
+ * BIOS data area is a buffer in the host process, and BIOS interrupts are
+ * emulated by the benchmark that needs them.
+ */
+
+#ifndef __PLATFORM_BIOS_H
+#define __PLATFORM_BIOS_H
+
+#include <lib/string.h>
+#include <x86/cpu.h>
+#include <types.h>
+
+extern char bench_bios_mem[];
+
+#define BIOS_MEM_BASE		((ptr_t)bench_bios_mem)
+#define BIOS_MEM_SIZE		0xE000
+
+/** Structure describing registers to pass to a BIOS interrupt. */
+typedef struct bios_regs {
+	uint32_t eflags;
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+	uint32_t edi;
+	uint32_t esi;
+	uint32_t ebp;
+	uint32_t _es;
+} bios_regs_t;
+
+static inline void bios_regs_init(bios_regs_t *regs) {
+	memset(regs, 0, sizeof(bios_regs_t));
+}
+
+extern void bios_interrupt(uint8_t num, bios_regs_t *regs);
+
+#endif /* __PLATFORM_BIOS_H */
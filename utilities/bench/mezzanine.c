@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Mezzanine loader benchmark.
+ *
+ * Runs the Mezzanine loader's image loading against a file-backed disk and
+ * simulated physical memory. The loader source is included directly so that
+ * each phase of mezzanine_loader_load() can be run and timed separately. The
+ * BIOS E820 call is emulated from a fixed memory map, and the real x86 MMU
+ * code builds the page tables in simulated memory.
+ *
+ * Images can be generated with mkmezzanine.py. Pages in generated images
+ * start with their virtual address, which is checked after loading.
+ */
+
+#include <loaders/mezzanine.c>
+
+#include "bench.h"
+
+/** Size of simulated physical memory. */
+#define MEZZANINE_BENCH_MEMORY	0x400000000ul
+
+/** Simulated E820 memory map, laid out like a typical PC. */
+static e820_entry_t bench_e820_map[] = {
+	{ 0x0, 0x9f000, E820_TYPE_FREE, 0 },
+	{ 0x9f000, 0x1000, E820_TYPE_RESERVED, 0 },
+	{ 0xe0000, 0x20000, E820_TYPE_RESERVED, 0 },
+	{ 0x100000, 0xbfe00000, E820_TYPE_FREE, 0 },
+	{ 0xbff00000, 0x100000, E820_TYPE_ACPI_RECLAIM, 0 },
+	{ 0xfec00000, 0x1400000, E820_TYPE_RESERVED, 0 },
+	{ 0x100000000, MEZZANINE_BENCH_MEMORY - 0x100000000, E820_TYPE_FREE, 0 },
+};
+
+/** BIOS data area used by the loader. */
+char bench_bios_mem[BIOS_MEM_SIZE] __aligned(PAGE_SIZE);
+
+/** Default video mode (there is no video in the host build). */
+vbe_mode_t *default_vbe_mode = NULL;
+
+/** Times at which each boot phase was reached. */
+static uint64_t trace_times[TRACE_PHASE_COUNT];
+
+/** Emulate a BIOS interrupt.
+ * @param num		Interrupt number.
+ * @param regs		Registers for the call. */
+void bios_interrupt(uint8_t num, bios_regs_t *regs) {
+	uint32_t offset;
+
+	if(num != 0x15 || regs->eax != 0xE820)
+		internal_error("Unexpected BIOS interrupt 0x%x (EAX 0x%x)", num, regs->eax);
+
+	if(regs->ebx >= ARRAY_SIZE(bench_e820_map)) {
+		regs->eflags |= X86_FLAGS_CF;
+		return;
+	}
+
+	/* EDI only holds the low 32 bits of the buffer address. */
+	offset = regs->edi - (uint32_t)BIOS_MEM_BASE;
+	memcpy(&bench_bios_mem[offset], &bench_e820_map[regs->ebx], sizeof(e820_entry_t));
+
+	regs->eax = E820_SMAP;
+	regs->ecx = sizeof(e820_entry_t);
+	regs->ebx = (regs->ebx + 1 < ARRAY_SIZE(bench_e820_map)) ? regs->ebx + 1 : 0;
+}
+
+/** Find a VBE mode (there are none in the host build).
+ * @return		Always NULL. */
+vbe_mode_t *vbe_mode_find(uint16_t width, uint16_t height, uint8_t depth) {
+	return NULL;
+}
+
+/** Set a VBE mode (does nothing in the host build). */
+void vbe_mode_set(vbe_mode_t *mode) {}
+
+/** Perform pre-boot tasks (does nothing in the host build). */
+void loader_preboot(void) {}
+
+/** Enter a Mezzanine kernel (not possible in the host build). */
+void mezzanine_arch_enter(phys_ptr_t transition_pml4, phys_ptr_t pml4, uint64_t entry_fref,
+	uint64_t initial_process, uint64_t boot_information_location)
+{
+	internal_error("Cannot enter a Mezzanine kernel on the host");
+}
+
+/** Record the start of a boot phase.
+ * @param phase		Phase that is starting. */
+void trace_phase(trace_phase_t phase) {
+	trace_times[phase] = bench_time();
+}
+
+/** Get the time at which a boot phase started.
+ * @param phase		Phase to get.
+ * @return		Time in nanoseconds. */
+uint64_t trace_timestamp(trace_phase_t phase) {
+	return trace_times[phase];
+}
+
+/** Get the frequency of trace timestamps.
+ * @return		Frequency in Hz. */
+uint64_t trace_frequency(void) {
+	return 1000000000;
+}
+
+/** Reset simulated physical memory to the state the PC platform leaves it. */
+static void reset_memory(void) {
+	memory_range_t *range;
+	phys_ptr_t start, end;
+	size_t i;
+
+	while(!list_empty(&memory_ranges)) {
+		range = list_entry(memory_ranges.next, memory_range_t, header);
+		list_remove(&range->header);
+		kfree(range);
+	}
+
+	for(i = 0; i < ARRAY_SIZE(bench_e820_map); i++) {
+		if(bench_e820_map[i].type != E820_TYPE_FREE)
+			continue;
+
+		start = ROUND_UP(bench_e820_map[i].start, PAGE_SIZE);
+		end = ROUND_DOWN(bench_e820_map[i].start + bench_e820_map[i].length, PAGE_SIZE);
+		phys_memory_add(start, end - start, PHYS_MEMORY_FREE);
+	}
+}
+
+/** Check that every page of a loaded image has the expected contents.
+ * @param loader	Loader for the image.
+ * @param mmu		MMU context the image was loaded into.
+ * @return		Number of incorrect pages. */
+static unsigned long check_image(mezzanine_loader_t *loader, mmu_context_t *mmu) {
+	unsigned long errors = 0;
+	uint64_t virtual, end, expected, value;
+	uint64_t *bml1;
+	uint32_t i;
+
+	for(i = 0; i < loader->header.n_extents; i++) {
+		if(loader->header.extents[i].flags & EXTENT_FLAG_ALIAS)
+			continue;
+
+		virtual = loader->header.extents[i].virtual_base;
+		end = virtual + loader->header.extents[i].size;
+		while(virtual < end) {
+			bml1 = read_block_map_l1(loader, virtual);
+			if(bml1 && bml1[(virtual >> 12) & 0x1FF] & BLOCK_MAP_PRESENT) {
+				expected = (bml1[(virtual >> 12) & 0x1FF] & BLOCK_MAP_ZERO_FILL) ? 0 : virtual;
+				mmu_memcpy_from(mmu, &value, virtual, sizeof(value));
+				if(value != expected) {
+					if(!errors) {
+						kprintf("Page 0x%" PRIx64 " contains 0x%" PRIx64 ", expected 0x%" PRIx64 "\n",
+							virtual, value, expected);
+					}
+					errors++;
+				}
+			}
+
+			virtual += PAGE_SIZE;
+		}
+	}
+
+	return errors;
+}
+
+/** Run the Mezzanine loader benchmark.
+ * @param count		Number of times to load the image.
+ * @param image		Path to the Mezzanine image.
+ * @return		0 on success, 1 on failure. */
+int bench_mezzanine(unsigned long count, const char *image) {
+	unsigned long start, map_time = 0, extent_time = 0, read_time = 0, buddy_time = 0;
+	unsigned long reads = 0, bytes = 0, seeks = 0, segments = 0, errors;
+	mezzanine_boot_information_t *boot_info;
+	mezzanine_loader_t *loader;
+	phys_ptr_t boot_info_page;
+	mmu_context_t *mmu;
+	device_t *device;
+	unsigned long i;
+	void *mem;
+
+	mem = bench_phys_map(MEZZANINE_BENCH_MEMORY);
+	if(!mem)
+		return 1;
+
+	bench_phys_offset = (ptr_t)mem;
+
+	bench_disk_image = image;
+	disk_init();
+	device = boot_device;
+	if(!device || device->type != DEVICE_TYPE_DISK) {
+		kprintf("Could not open '%s'\n", image);
+		return 1;
+	}
+
+	loader = kmalloc(sizeof(*loader));
+	if(!disk_read((disk_t *)device, &loader->header, sizeof(loader->header), 0)) {
+		kprintf("Could not read header\n");
+		return 1;
+	} else if(memcmp(loader->header.magic, mezzanine_magic, 16) != 0) {
+		kprintf("'%s' is not a Mezzanine image\n", image);
+		return 1;
+	} else if(loader->header.protocol_major != mezzanine_protocol_major
+		|| loader->header.protocol_minor != mezzanine_protocol_minor)
+	{
+		kprintf("Image has protocol %u.%u, loader supports %u.%u\n",
+			loader->header.protocol_major, loader->header.protocol_minor,
+			mezzanine_protocol_major, mezzanine_protocol_minor);
+		return 1;
+	}
+
+	kprintf("Loading '%s' (%" PRIu32 " extents) into %lu MiB of memory\n", image,
+		loader->header.n_extents, MEZZANINE_BENCH_MEMORY / 1024 / 1024);
+
+	for(i = 0; i < count; i++) {
+		reset_memory();
+
+		loader->disk = (disk_t *)device;
+		memset(loader->block_cache, 0, sizeof(loader->block_cache));
+		list_init(&loader->block_cache_lru);
+		loader->block_cache_count = 0;
+		loader->last_bml2_block = 0;
+
+		mmu = mmu_context_create(TARGET_TYPE_64BIT, PHYS_MEMORY_PAGETABLES);
+		phys_memory_alloc(PAGE_SIZE, 0x1000, 0x100000, 0, PHYS_MEMORY_ALLOCATED, 0,
+			&boot_info_page);
+		boot_info = (mezzanine_boot_information_t *)P2V(boot_info_page);
+		memset(boot_info, 0, PAGE_SIZE);
+
+		start = bench_time();
+		generate_memory_map(mmu, boot_info);
+		map_time += bench_time() - start;
+
+		start = bench_time();
+		load_extents(loader, mmu);
+		extent_time += bench_time() - start;
+
+		reads -= bench_disk_reads;
+		bytes -= bench_disk_bytes;
+		seeks -= bench_disk_seeks;
+		start = bench_time();
+		read_segments(loader);
+		read_time += bench_time() - start;
+		reads += bench_disk_reads;
+		bytes += bench_disk_bytes;
+		seeks += bench_disk_seeks;
+		segments += loader->n_segments;
+
+		start = bench_time();
+		memory_finalize();
+		build_buddy_allocator(mmu, boot_info, loader->header.nil);
+		buddy_time += bench_time() - start;
+
+		errors = check_image(loader, mmu);
+		if(errors) {
+			kprintf("%lu pages were loaded incorrectly\n", errors);
+			return 1;
+		}
+	}
+
+	bench_report("generate_memory_map", count, map_time);
+	bench_report("load_extents", count, extent_time);
+	bench_report("read_segments", count, read_time);
+	bench_report("build_buddy_allocator", count, buddy_time);
+	kprintf("  %lu segments, %lu disk reads (%lu non-sequential), %lu MiB read\n",
+		segments / count, reads / count, seeks / count, bytes / count / 1024 / 1024);
+	return 0;
+}
@@ -0,0 +1,274 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2012 Alex Smith
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+# ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+# WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+# ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+# OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+#
+
+# Synthetic Mezzanine image generator.
+#
+# Writes an image with the mezzanine_header_t layout and a 4-level block map,
+# for use with the mezzanine benchmark of kboot-bench. The image contains a
+# number of extents with holes, zero-fill pages and optionally LZ4-compressed
+# groups. The first 8 bytes of each page hold its virtual address so that the
+# benchmark can check that every page was loaded to the right place.
+#
+# --fragment controls how far the block order differs from the virtual address
+# order: 0 lays pages out in address order, 1 in a completely random order.
+# Real images are laid out by the GC and writeback order, somewhere between.
+
+import argparse
+import random
+import struct
+import sys
+import uuid
+
+# Must match the values in source/loaders/mezzanine.c.
+MAGIC = b'\x00MezzanineImage\x00'
+PROTOCOL_MAJOR = 0
+PROTOCOL_MINOR = 26
+MAX_EXTENTS = 64
+
+BLOCK_SIZE = 0x1000
+PAGE_SIZE = 0x1000
+
+BLOCK_MAP_PRESENT = 1
+BLOCK_MAP_WRITABLE = 2
+BLOCK_MAP_ZERO_FILL = 4
+BLOCK_MAP_COMPRESSED = 8
+BLOCK_MAP_GROUP_INDEX_SHIFT = 4
+BLOCK_MAP_ID_SHIFT = 8
+
+# Pages in a compressed group.
+GROUP_PAGES = 16
+
+# Virtual address of the first extent, and the spacing between extents.
+EXTENT_BASE = 0x200000000000
+EXTENT_SPACING = 0x8000000000
+
+# A value for nil that cannot be mistaken for a fixnum.
+NIL = 0x200000000009
+
+def fail(msg):
+    print('mkmezzanine: %s' % (msg), file=sys.stderr)
+    sys.exit(1)
+
+def lz4_length(n):
+    out = bytearray()
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+    return out
+
+def lz4_sequence(literals, match):
+    """Encode an LZ4 sequence with a match at offset 1."""
+    token = min(len(literals), 15) << 4
+    if match:
+        token |= min(match - 4, 15)
+    out = bytearray([token])
+    if len(literals) >= 15:
+        out += lz4_length(len(literals) - 15)
+    out += literals
+    if match:
+        out += struct.pack('<H', 1)
+        if match - 4 >= 15:
+            out += lz4_length(match - 4 - 15)
+    return out
+
+def compress_group(pages):
+    """Compress a group of pages, each its address followed by zeros."""
+    out = bytearray()
+    for i, virtual in enumerate(pages):
+        literals = struct.pack('<Q', virtual) + b'\0'
+        if i == len(pages) - 1:
+            # The last 5 bytes of a block must be literals.
+            out += lz4_sequence(literals, PAGE_SIZE - len(literals) - 5)
+            out += lz4_sequence(b'\0' * 5, 0)
+        else:
+            out += lz4_sequence(literals, PAGE_SIZE - len(literals))
+    data = struct.pack('<II', len(out), len(pages) * PAGE_SIZE) + out
+    return data + b'\0' * (-len(data) % BLOCK_SIZE)
+
+def page_data(virtual):
+    return struct.pack('<Q', virtual) + b'\0' * (PAGE_SIZE - 8)
+
+def generate_extent(args, rng, base, pages):
+    """Return a list of (virtual, kind) for present pages in an extent."""
+    out = []
+    virtual = base
+    end = base + pages * PAGE_SIZE
+    present = True
+    while virtual < end:
+        # Alternate runs of present and absent pages, with lengths chosen to
+        # give the requested fraction of holes.
+        if present:
+            mean = args.run
+        elif args.holes < 1:
+            mean = args.run * args.holes / (1 - args.holes)
+        else:
+            mean = pages
+        count = max(1, int(rng.expovariate(1 / mean))) if mean >= 1 else 0
+        count = min(count, (end - virtual) // PAGE_SIZE)
+        if present:
+            for i in range(count):
+                zero = rng.random() < args.zero_fill
+                out.append((virtual + i * PAGE_SIZE, 'zero' if zero else 'data'))
+        virtual += count * PAGE_SIZE
+        present = not present
+    return out
+
+def main():
+    parser = argparse.ArgumentParser(description = 'Generate a synthetic Mezzanine image.')
+    parser.add_argument('output', help = 'Path to write the image to')
+    parser.add_argument('--size', type = int, default = 256,
+        help = 'Total size of the extents in MiB (default 256)')
+    parser.add_argument('--extents', type = int, default = 4,
+        help = 'Number of extents (default 4)')
+    parser.add_argument('--holes', type = float, default = 0.25,
+        help = 'Fraction of pages that are not present (default 0.25)')
+    parser.add_argument('--zero-fill', type = float, default = 0.1,
+        help = 'Fraction of present pages that are zero-fill (default 0.1)')
+    parser.add_argument('--compress', type = float, default = 0,
+        help = 'Fraction of data pages stored in compressed groups (default 0)')
+    parser.add_argument('--fragment', type = float, default = 0,
+        help = 'Fraction of the image laid out out of order (default 0)')
+    parser.add_argument('--run', type = float, default = 64,
+        help = 'Mean length of a run of present pages (default 64)')
+    parser.add_argument('--seed', type = int, default = 0,
+        help = 'Random number generator seed (default 0)')
+    args = parser.parse_args()
+
+    if args.extents < 1 or args.extents > MAX_EXTENTS:
+        fail('number of extents must be between 1 and %d' % (MAX_EXTENTS))
+    for name in ['holes', 'zero_fill', 'compress', 'fragment']:
+        if not 0 <= getattr(args, name) <= 1:
+            fail('--%s must be between 0 and 1' % (name.replace('_', '-')))
+
+    rng = random.Random(args.seed)
+    extent_pages = args.size * 1024 * 1024 // PAGE_SIZE // args.extents
+    if not extent_pages:
+        fail('image is too small')
+
+    extents = []
+    present = []
+    for i in range(args.extents):
+        base = EXTENT_BASE + i * EXTENT_SPACING
+        extents.append((base, extent_pages * PAGE_SIZE))
+        present += generate_extent(args, rng, base, extent_pages)
+
+    # Group data pages into units which each occupy consecutive blocks: a
+    # single page, or a compressed group of pages consecutive in memory.
+    units = []
+    group = []
+    for virtual, kind in present:
+        if kind != 'data':
+            continue
+        if group and (len(group) == GROUP_PAGES or group[-1] + PAGE_SIZE != virtual):
+            units.append(('group', group))
+            group = []
+        if rng.random() < args.compress:
+            group.append(virtual)
+        else:
+            units.append(('page', [virtual]))
+    if group:
+        units.append(('group', group))
+
+    # Shuffle a fraction of the units among their own positions.
+    positions = [i for i in range(len(units)) if rng.random() < args.fragment]
+    moved = [units[i] for i in positions]
+    rng.shuffle(moved)
+    for i, unit in zip(positions, moved):
+        units[i] = unit
+
+    # Build the block map as nested dictionaries down to the level 1 entries.
+    block_map = {}
+    def entry(virtual):
+        bml3 = block_map.setdefault((virtual >> 39) & 0x1FF, {})
+        bml2 = bml3.setdefault((virtual >> 30) & 0x1FF, {})
+        return bml2.setdefault((virtual >> 21) & 0x1FF, {})
+
+    for virtual, kind in present:
+        flags = BLOCK_MAP_PRESENT | BLOCK_MAP_WRITABLE
+        if kind == 'zero':
+            flags |= BLOCK_MAP_ZERO_FILL
+        entry(virtual)[(virtual >> 12) & 0x1FF] = flags
+
+    # Block 0 is the header, followed by the block map tables in depth-first
+    # order and then the data.
+    next_block = 1
+    def allocate_tables(table, level):
+        nonlocal next_block
+        block = next_block
+        next_block += 1
+        if level > 1:
+            table['block'] = block
+            for index in sorted(k for k in table if k != 'block'):
+                allocate_tables(table[index], level - 1)
+        else:
+            table['block'] = block
+        return block
+    bml4 = allocate_tables(block_map, 4)
+
+    # Assign blocks to data units and fill in the level 1 entries.
+    data = []
+    for kind, pages in units:
+        if kind == 'page':
+            entry(pages[0])[(pages[0] >> 12) & 0x1FF] |= next_block << BLOCK_MAP_ID_SHIFT
+            data.append(page_data(pages[0]))
+        else:
+            for index, virtual in enumerate(pages):
+                entry(virtual)[(virtual >> 12) & 0x1FF] |= (
+                    (next_block << BLOCK_MAP_ID_SHIFT) | BLOCK_MAP_COMPRESSED |
+                    (index << BLOCK_MAP_GROUP_INDEX_SHIFT))
+            data.append(compress_group(pages))
+        next_block += len(data[-1]) // BLOCK_SIZE
+
+    def encode_table(table, level):
+        out = [0] * 512
+        for index, child in table.items():
+            if index == 'block':
+                continue
+            if level > 1:
+                out[index] = (child['block'] << BLOCK_MAP_ID_SHIFT) | BLOCK_MAP_PRESENT
+            else:
+                out[index] = child
+        return struct.pack('<512Q', *out)
+
+    def write_tables(f, table, level):
+        f.write(encode_table(table, level))
+        if level > 1:
+            for index in sorted(k for k in table if k != 'block'):
+                write_tables(f, table[index], level - 1)
+
+    header = bytearray(BLOCK_SIZE)
+    struct.pack_into('<16s16sHHIQQQ', header, 0, MAGIC, uuid.UUID(int = rng.getrandbits(128)).bytes,
+        PROTOCOL_MAJOR, PROTOCOL_MINOR, len(extents), 0, 0, NIL)
+    struct.pack_into('<QQ', header, 96, bml4, 0)
+    for i, (base, size) in enumerate(extents):
+        struct.pack_into('<QQQQ', header, 112 + i * 32, base, size, 0, 0)
+
+    with open(args.output, 'wb') as f:
+        f.write(header)
+        write_tables(f, block_map, 4)
+        for unit in data:
+            f.write(unit)
+
+    zero = sum(1 for virtual, kind in present if kind == 'zero')
+    groups = sum(1 for kind, pages in units if kind == 'group')
+    print('%s: %d pages present (%d zero-fill), %d compressed groups, %d blocks' % (
+        args.output, len(present), zero, groups, next_block))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
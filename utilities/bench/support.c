@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2012 Alex Smith
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief		Loader support functions for the host build.
+ *
+ * Implements the parts of the loader core that are normally provided by the
+ * console and error handling code, or by the platform, on top of the host
+ * support code.
+ */
+
+#include <lib/printf.h>
+
+#include <config.h>
+#include <loader.h>
+
+#include "bench.h"
+
+/** Offset of simulated physical memory (0 unless a benchmark sets it up). */
+unsigned long bench_phys_offset = 0;
+
+/** Loader image boundaries, referenced by memory_init(). */
+char __start[1], __end[1];
+
+/** Helper for kvprintf().
+ * @param ch		Character to display.
+ * @param data		Ignored.
+ * @param total		Pointer to total character count. */
+static void kvprintf_helper(char ch, void *data, int *total) {
+	bench_putc(ch, 0);
+	*total = *total + 1;
+}
+
+/** Helper for dvprintf().
+ * @param ch		Character to display.
+ * @param data		Ignored.
+ * @param total		Pointer to total character count. */
+static void dvprintf_helper(char ch, void *data, int *total) {
+	bench_putc(ch, 1);
+	*total = *total + 1;
+}
+
+/** Output a formatted message.
+ * @param fmt		Format string used to create the message.
+ * @param args		Arguments to substitute into format.
+ * @return		Number of characters printed. */
+int kvprintf(const char *fmt, va_list args) {
+	return do_printf(kvprintf_helper, NULL, fmt, args);
+}
+
+/** Output a formatted message.
+ * @param fmt		Format string used to create the message.
+ * @param ...		Arguments to substitute into format.
+ * @return		Number of characters printed. */
+int kprintf(const char *fmt, ...) {
+	va_list args;
+	int ret;
+
+	va_start(args, fmt);
+	ret = kvprintf(fmt, args);
+	va_end(args);
+
+	return ret;
+}
+
+/** Output a formatted debug message (only shown in verbose mode).
+ * @param fmt		Format string used to create the message.
+ * @param args		Arguments to substitute into format.
+ * @return		Number of characters printed. */
+int dvprintf(const char *fmt, va_list args) {
+	return do_printf(dvprintf_helper, NULL, fmt, args);
+}
+
+/** Output a formatted debug message (only shown in verbose mode).
+ * @param fmt		Format string used to create the message.
+ * @param ...		Arguments to substitute into format.
+ * @return		Number of characters printed. */
+int dprintf(const char *fmt, ...) {
+	va_list args;
+	int ret;
+
+	va_start(args, fmt);
+	ret = dvprintf(fmt, args);
+	va_end(args);
+
+	return ret;
+}
+
+/** Raise an internal error.
+ * @param fmt		Error format string.
+ * @param ...		Values to substitute into format. */
+void internal_error(const char *fmt, ...) {
+	va_list args;
+
+	kprintf("Internal Error: ");
+	va_start(args, fmt);
+	kvprintf(fmt, args);
+	va_end(args);
+	kprintf("\n");
+
+	bench_abort();
+}
+
+/** Display details of a boot error.
+ * @param fmt		Error format string.
+ * @param ...		Values to substitute into format. */
+void boot_error(const char *fmt, ...) {
+	va_list args;
+
+	kprintf("Boot Error: ");
+	va_start(args, fmt);
+	kvprintf(fmt, args);
+	va_end(args);
+	kprintf("\n");
+
+	bench_abort();
+}